@@ -0,0 +1,650 @@
+// lahmacun-bench: microbenchmarks for setCache/getCache/deleteCache.
+//
+// Every case sweeps one dimension (key size, value size, fill level, hit
+// ratio, thread count) around a base point and reports ns/op and ops/sec.
+// Results go to stdout (or --out FILE) as JSON, one object per case.
+// get_batch runs the same gets through getCacheBatch, BENCH_BATCH keys at
+// a time. --large-fill N adds get and get_batch cases over N resident keys,
+// to be set well past the last level cache so that lookups go to DRAM.
+// Every case also reports the workers' dTLB load misses per op, where the
+// CPU (and hypervisor) expose that counter to perf_event_open; compare a
+// run with --huge-pages to one without to see what 2 MB pages save.
+// --kernels instead times the key compare and hash functions on their own,
+// the old byte loops next to the SIMD ones, for 16-256 byte keys.
+//
+// Build (see README):
+//   cc -O2 -pthread -DLAHMACUN_NO_MAIN -DLAHMACUN_QUIET lahmacun-bench.c lahmacun[a-z]*.c -lm -o lahmacun-bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "lahmacuncache.h"
+#include "lahmacunsimd.h"
+
+#define BASE_KEY_SIZE 16
+#define BASE_VALUE_SIZE 64
+#define BASE_FILL 10000
+#define BASE_HIT_PERCENT 100
+#define BENCH_BATCH 32
+
+typedef enum
+{
+    OP_SET,
+    OP_GET,
+    OP_DELETE,
+    OP_GET_BATCH
+} BenchOp;
+
+static const char *op_names[] = {"set", "get", "delete", "get_batch"};
+
+typedef struct
+{
+    BenchOp op;
+    size_t key_size;
+    size_t value_size;
+    size_t fill;
+    int hit_percent;
+    int threads;
+} BenchCase;
+
+typedef struct
+{
+    size_t ops;
+    int max_threads;
+    int repetitions;
+    const char *filter;
+    int kernels;
+    size_t large_fill;
+    FILE *out;
+    CacheOptions options;
+} BenchConfig;
+
+typedef struct
+{
+    Cache *cache;
+    const BenchCase *bc;
+    char **keys;
+    size_t count;
+    const char *value;
+    pthread_mutex_t *gate_lock;
+    pthread_cond_t *gate_cond;
+    int *gate_open;
+    struct timespec start;
+    struct timespec end;
+    int64_t tlb_misses; // -1: no counter
+} BenchWorker;
+
+static double nowSeconds(const struct timespec *ts)
+{
+    return (double)ts->tv_sec + (double)ts->tv_nsec / 1e9;
+}
+
+// "k:" followed by n in base 36, zero padded to exactly key_size - 1
+// characters so that even 8 byte keys stay unique
+static char *makeKey(size_t n, size_t key_size)
+{
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char *key = malloc(key_size);
+    key[0] = 'k';
+    key[1] = ':';
+    for (size_t i = key_size - 2; i >= 2; i--)
+    {
+        key[i] = digits[n % 36];
+        n /= 36;
+    }
+    key[key_size - 1] = '\0';
+    return key;
+}
+
+static char **makeKeys(size_t first, size_t count, size_t key_size)
+{
+    char **keys = malloc(count * sizeof(char *));
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i] = makeKey(first + i, key_size);
+    }
+    return keys;
+}
+
+static void freeKeys(char **keys, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+// Fisher-Yates with a fixed seed so every run touches keys in the same order
+static void shuffleKeys(char **keys, size_t count, unsigned int seed)
+{
+    for (size_t i = count; i > 1; i--)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t j = (size_t)(seed >> 8) % i;
+        char *tmp = keys[i - 1];
+        keys[i - 1] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+// Counts the calling thread's dTLB load misses in user space; -1 when no
+// such counter is available (no PMU in the VM, perf_event_paranoid)
+static int tlbCounterOpen(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void *benchWorker(void *arg)
+{
+    BenchWorker *w = arg;
+
+    pthread_mutex_lock(w->gate_lock);
+    while (!*w->gate_open)
+    {
+        pthread_cond_wait(w->gate_cond, w->gate_lock);
+    }
+    pthread_mutex_unlock(w->gate_lock);
+
+    int tlb = tlbCounterOpen();
+    if (tlb >= 0)
+    {
+        ioctl(tlb, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w->start);
+    switch (w->bc->op)
+    {
+    case OP_SET:
+        for (size_t i = 0; i < w->count; i++)
+        {
+            setCache(w->cache, w->keys[i], w->value, 3600);
+        }
+        break;
+    case OP_GET:
+        for (size_t i = 0; i < w->count; i++)
+        {
+            const char *volatile v = getCache(w->cache, w->keys[i]);
+            (void)v;
+        }
+        break;
+    case OP_DELETE:
+        for (size_t i = 0; i < w->count; i++)
+        {
+            deleteCache(w->cache, w->keys[i]);
+        }
+        break;
+    case OP_GET_BATCH:
+    {
+        char *bufs = malloc(BENCH_BATCH * w->bc->value_size);
+        int results[BENCH_BATCH];
+        for (size_t i = 0; i < w->count; i += BENCH_BATCH)
+        {
+            size_t n = w->count - i < BENCH_BATCH ? w->count - i : BENCH_BATCH;
+            getCacheBatch(w->cache, (const char *const *)w->keys + i, n, bufs, w->bc->value_size, results);
+        }
+        free(bufs);
+        break;
+    }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &w->end);
+    w->tlb_misses = -1;
+    if (tlb >= 0)
+    {
+        uint64_t misses;
+        ioctl(tlb, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(tlb, &misses, sizeof(misses)) == sizeof(misses))
+        {
+            w->tlb_misses = (int64_t)misses;
+        }
+        close(tlb);
+    }
+    return NULL;
+}
+
+// Runs one case once and returns the wall time in seconds, and in
+// *tlb_misses the workers' dTLB misses (-1 without a counter)
+static double runOnce(const BenchCase *bc, const BenchConfig *cfg, int64_t *tlb_misses)
+{
+    size_t ops = cfg->ops;
+    Cache *cache = createCacheWithOptions(&cfg->options);
+    char *value = malloc(bc->value_size);
+    memset(value, 'v', bc->value_size - 1);
+    value[bc->value_size - 1] = '\0';
+
+    char **resident = makeKeys(0, bc->fill, bc->key_size);
+    for (size_t i = 0; i < bc->fill; i++)
+    {
+        setCache(cache, resident[i], value, 3600);
+    }
+
+    // Operation keys: hits come from the resident set, misses from a
+    // disjoint range. set always inserts keys not yet in the table, and
+    // delete's hits are inserted up front so each is removed exactly once.
+    // When the resident set outnumbers the operations, hits are spread
+    // over all of it rather than taken from its (recently inserted, still
+    // cached) start.
+    size_t hits = bc->op == OP_SET ? 0 : ops * (size_t)bc->hit_percent / 100;
+    char **op_keys = malloc(ops * sizeof(char *));
+    for (size_t i = 0; i < ops; i++)
+    {
+        if (i < hits && (bc->op == OP_GET || bc->op == OP_GET_BATCH))
+        {
+            size_t n = bc->fill > ops ? i * (bc->fill / ops) : i % (bc->fill ? bc->fill : 1);
+            op_keys[i] = makeKey(n, bc->key_size);
+        }
+        else
+        {
+            op_keys[i] = makeKey(bc->fill + i, bc->key_size);
+        }
+    }
+    if (bc->op == OP_DELETE)
+    {
+        for (size_t i = 0; i < hits; i++)
+        {
+            setCache(cache, op_keys[i], value, 3600);
+        }
+    }
+    shuffleKeys(op_keys, ops, 42);
+
+    pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+    int gate_open = 0;
+    pthread_t *tids = malloc((size_t)bc->threads * sizeof(pthread_t));
+    BenchWorker *workers = calloc((size_t)bc->threads, sizeof(BenchWorker));
+    size_t per_thread = ops / (size_t)bc->threads;
+
+    for (int t = 0; t < bc->threads; t++)
+    {
+        BenchWorker *w = &workers[t];
+        w->cache = cache;
+        w->bc = bc;
+        w->keys = op_keys + (size_t)t * per_thread;
+        w->count = t == bc->threads - 1 ? ops - (size_t)t * per_thread : per_thread;
+        w->value = value;
+        w->gate_lock = &gate_lock;
+        w->gate_cond = &gate_cond;
+        w->gate_open = &gate_open;
+        pthread_create(&tids[t], NULL, benchWorker, w);
+    }
+
+    pthread_mutex_lock(&gate_lock);
+    gate_open = 1;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_lock);
+
+    double first = 0, last = 0;
+    *tlb_misses = 0;
+    for (int t = 0; t < bc->threads; t++)
+    {
+        pthread_join(tids[t], NULL);
+        if (workers[t].tlb_misses < 0 || *tlb_misses < 0)
+        {
+            *tlb_misses = -1;
+        }
+        else
+        {
+            *tlb_misses += workers[t].tlb_misses;
+        }
+        double s = nowSeconds(&workers[t].start);
+        double e = nowSeconds(&workers[t].end);
+        if (t == 0 || s < first)
+        {
+            first = s;
+        }
+        if (t == 0 || e > last)
+        {
+            last = e;
+        }
+    }
+
+    free(workers);
+    free(tids);
+    freeKeys(op_keys, ops);
+    freeKeys(resident, bc->fill);
+    free(value);
+    freeCache(cache);
+    return last - first;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void caseName(const BenchCase *bc, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s/key:%zu/value:%zu/fill:%zu/hit:%d/threads:%d",
+             op_names[bc->op], bc->key_size, bc->value_size, bc->fill,
+             bc->hit_percent, bc->threads);
+}
+
+static void runCase(const BenchCase *bc, const BenchConfig *cfg, int *first)
+{
+    char name[128];
+    caseName(bc, name, sizeof(name));
+    if (cfg->filter && !strstr(name, cfg->filter))
+    {
+        return;
+    }
+
+    double *times = malloc((size_t)cfg->repetitions * sizeof(double));
+    int64_t tlb_total = 0;
+    for (int r = 0; r < cfg->repetitions; r++)
+    {
+        int64_t tlb_misses;
+        times[r] = runOnce(bc, cfg, &tlb_misses);
+        tlb_total = tlb_misses < 0 || tlb_total < 0 ? -1 : tlb_total + tlb_misses;
+    }
+    qsort(times, (size_t)cfg->repetitions, sizeof(double), compareDouble);
+    double median = times[cfg->repetitions / 2];
+    double best = times[0];
+    free(times);
+
+    // ns_per_op is per thread: wall time divided by each thread's share
+    double per_thread_ops = (double)cfg->ops / bc->threads;
+    char tlb[32] = "null";
+    if (tlb_total >= 0)
+    {
+        snprintf(tlb, sizeof(tlb), "%.3f", (double)tlb_total / ((double)cfg->ops * cfg->repetitions));
+    }
+    fprintf(cfg->out,
+            "%s    {\"name\": \"%s\", \"op\": \"%s\", \"key_size\": %zu, "
+            "\"value_size\": %zu, \"fill\": %zu, \"hit_percent\": %d, "
+            "\"threads\": %d, \"iterations\": %zu, \"repetitions\": %d, "
+            "\"real_time_s\": %.6f, \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+            "\"ops_per_sec\": %.0f, \"dtlb_misses_per_op\": %s}",
+            *first ? "" : ",\n", name, op_names[bc->op], bc->key_size,
+            bc->value_size, bc->fill, bc->hit_percent, bc->threads, cfg->ops,
+            cfg->repetitions, median, median * 1e9 / per_thread_ops,
+            best * 1e9 / per_thread_ops, (double)cfg->ops / median, tlb);
+    fflush(cfg->out);
+    *first = 0;
+    fprintf(stderr, "%-60s %10.1f ns/op\n", name, median * 1e9 / per_thread_ops);
+}
+
+typedef enum
+{
+    KERNEL_STRCMP,
+    KERNEL_MEMCMP,
+    KERNEL_KEY_EQUAL,
+    KERNEL_DJB2,
+    KERNEL_CRC32C,
+    KERNEL_SIPHASH
+} BenchKernel;
+
+static const char *kernel_names[] = {"strcmp", "memcmp", "keyEqual", "djb2", "crc32c", "siphash13"};
+
+#define KERNEL_KEYS 64
+
+// Equal keys in separate buffers, so a compare always runs to the end
+static double runKernelOnce(BenchKernel kernel, size_t key_size, size_t ops)
+{
+    char *keys[KERNEL_KEYS], *copies[KERNEL_KEYS];
+    size_t len = key_size - 1;
+    for (int i = 0; i < KERNEL_KEYS; i++)
+    {
+        keys[i] = makeKey((size_t)i, key_size);
+        copies[i] = makeKey((size_t)i, key_size);
+    }
+    uint64_t seed[2] = {1, 2};
+    uint64_t sink = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < ops; i++)
+    {
+        const char *a = keys[i % KERNEL_KEYS], *b = copies[i % KERNEL_KEYS];
+        switch (kernel)
+        {
+        case KERNEL_STRCMP:
+            sink += strcmp(a, b) == 0;
+            break;
+        case KERNEL_MEMCMP:
+            sink += memcmp(a, b, len) == 0;
+            break;
+        case KERNEL_KEY_EQUAL:
+            sink += keyEqual(a, b, len);
+            break;
+        case KERNEL_DJB2:
+            sink += hash(a, 1u << 31);
+            break;
+        case KERNEL_CRC32C:
+            sink += keyCrc32c(a, len);
+            break;
+        case KERNEL_SIPHASH:
+            sink += sipHash13(a, len, seed);
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    volatile uint64_t keep = sink;
+    (void)keep;
+    for (int i = 0; i < KERNEL_KEYS; i++)
+    {
+        free(keys[i]);
+        free(copies[i]);
+    }
+    return nowSeconds(&end) - nowSeconds(&start);
+}
+
+static void runKernelCase(BenchKernel kernel, size_t key_size, const BenchConfig *cfg, int *first)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "kernel:%s/key:%zu", kernel_names[kernel], key_size);
+    if (cfg->filter && !strstr(name, cfg->filter))
+    {
+        return;
+    }
+
+    double *times = malloc((size_t)cfg->repetitions * sizeof(double));
+    for (int r = 0; r < cfg->repetitions; r++)
+    {
+        times[r] = runKernelOnce(kernel, key_size, cfg->ops);
+    }
+    qsort(times, (size_t)cfg->repetitions, sizeof(double), compareDouble);
+    double median = times[cfg->repetitions / 2];
+    double best = times[0];
+    free(times);
+
+    fprintf(cfg->out,
+            "%s    {\"name\": \"%s\", \"kernel\": \"%s\", \"key_size\": %zu, "
+            "\"iterations\": %zu, \"repetitions\": %d, \"real_time_s\": %.6f, "
+            "\"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f}",
+            *first ? "" : ",\n", name, kernel_names[kernel], key_size, cfg->ops,
+            cfg->repetitions, median, median * 1e9 / cfg->ops, best * 1e9 / cfg->ops);
+    fflush(cfg->out);
+    *first = 0;
+    fprintf(stderr, "%-60s %10.2f ns/op\n", name, median * 1e9 / cfg->ops);
+}
+
+// 1, 2, 4, ... doubling, always ending on max
+static int nextThreadCount(int t, int max)
+{
+    if (t == max)
+    {
+        return max + 1;
+    }
+    return t * 2 > max ? max : t * 2;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--ops N] [--threads N] [--repetitions N] [--filter SUBSTR] [--latency] [--huge-pages] [--large-fill N] [--kernels] [--out FILE]\n"
+            "  --ops N          operations per case, split across threads (default 100000)\n"
+            "  --threads N      sweep thread counts 1,2,4..N (default: online CPUs)\n"
+            "  --repetitions N  runs per case, the median is reported (default 3)\n"
+            "  --filter SUBSTR  only run cases whose name contains SUBSTR\n"
+            "  --latency        create caches with latency histograms on (measures their overhead)\n"
+            "  --huge-pages     create caches with bucket arrays and entries on 2 MB pages\n"
+            "  --large-fill N   also time get and get_batch with N resident keys (default: off)\n"
+            "  --kernels        time key compare and hash functions instead of cache operations\n"
+            "  --out FILE       write JSON to FILE instead of stdout\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg = {100000, (int)sysconf(_SC_NPROCESSORS_ONLN), 3, NULL, 0, 0, stdout, {0}};
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--ops") && i + 1 < argc)
+        {
+            cfg.ops = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            cfg.max_threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--repetitions") && i + 1 < argc)
+        {
+            cfg.repetitions = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+        {
+            cfg.filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--latency"))
+        {
+            cfg.options.latency_histograms = 1;
+        }
+        else if (!strcmp(argv[i], "--huge-pages"))
+        {
+            cfg.options.huge_pages = 1;
+        }
+        else if (!strcmp(argv[i], "--large-fill") && i + 1 < argc)
+        {
+            cfg.large_fill = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], "--kernels"))
+        {
+            cfg.kernels = 1;
+        }
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc)
+        {
+            cfg.out = fopen(argv[++i], "w");
+            if (!cfg.out)
+            {
+                perror("fopen");
+                return 1;
+            }
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.ops == 0 || cfg.max_threads < 1 || cfg.repetitions < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static const size_t key_sizes[] = {8, 16, 64, 200};
+    static const size_t value_sizes[] = {16, 64, 256, 1000};
+    static const size_t fills[] = {1000, 10000, 100000};
+    static const int hit_percents[] = {100, 50, 0};
+    static const size_t kernel_key_sizes[] = {16, 32, 64, 128, 256};
+
+    time_t now = time(NULL);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    fprintf(cfg.out,
+            "{\n  \"context\": {\"date\": \"%s\", \"num_cpus\": %ld, \"ops\": %zu, "
+            "\"repetitions\": %d, \"max_threads\": %d, \"latency_histograms\": %d, \"huge_pages\": %d, "
+            "\"equal_kernel\": \"%s\", \"crc32c\": %d},\n  \"benchmarks\": [\n",
+            date, sysconf(_SC_NPROCESSORS_ONLN), cfg.ops, cfg.repetitions,
+            cfg.max_threads, cfg.options.latency_histograms, cfg.options.huge_pages, simdEqualKernel(), simdCrcActive());
+
+    int first = 1;
+    for (int kernel = KERNEL_STRCMP; cfg.kernels && kernel <= KERNEL_SIPHASH; kernel++)
+    {
+        for (size_t i = 0; i < sizeof(kernel_key_sizes) / sizeof(*kernel_key_sizes); i++)
+        {
+            runKernelCase((BenchKernel)kernel, kernel_key_sizes[i], &cfg, &first);
+        }
+    }
+    for (int op = OP_SET; !cfg.kernels && op <= OP_GET_BATCH; op++)
+    {
+        BenchCase base = {(BenchOp)op, BASE_KEY_SIZE, BASE_VALUE_SIZE, BASE_FILL,
+                          BASE_HIT_PERCENT, 1};
+        BenchCase bc;
+
+        for (size_t i = 0; i < sizeof(key_sizes) / sizeof(*key_sizes); i++)
+        {
+            bc = base;
+            bc.key_size = key_sizes[i];
+            runCase(&bc, &cfg, &first);
+        }
+        for (size_t i = 0; i < sizeof(value_sizes) / sizeof(*value_sizes); i++)
+        {
+            if (value_sizes[i] == BASE_VALUE_SIZE)
+            {
+                continue;
+            }
+            bc = base;
+            bc.value_size = value_sizes[i];
+            runCase(&bc, &cfg, &first);
+        }
+        for (size_t i = 0; i < sizeof(fills) / sizeof(*fills); i++)
+        {
+            if (fills[i] == BASE_FILL)
+            {
+                continue;
+            }
+            bc = base;
+            bc.fill = fills[i];
+            runCase(&bc, &cfg, &first);
+        }
+        if (op != OP_SET)
+        {
+            for (size_t i = 0; i < sizeof(hit_percents) / sizeof(*hit_percents); i++)
+            {
+                if (hit_percents[i] == BASE_HIT_PERCENT)
+                {
+                    continue;
+                }
+                bc = base;
+                bc.hit_percent = hit_percents[i];
+                runCase(&bc, &cfg, &first);
+            }
+        }
+        for (int t = 2; t <= cfg.max_threads; t = nextThreadCount(t, cfg.max_threads))
+        {
+            bc = base;
+            bc.threads = t;
+            runCase(&bc, &cfg, &first);
+        }
+        if (cfg.large_fill && (op == OP_GET || op == OP_GET_BATCH))
+        {
+            bc = base;
+            bc.fill = cfg.large_fill;
+            runCase(&bc, &cfg, &first);
+        }
+    }
+
+    fprintf(cfg.out, "\n  ]\n}\n");
+    if (cfg.out != stdout)
+    {
+        fclose(cfg.out);
+    }
+    return 0;
+}
@@ -0,0 +1,868 @@
+// lahmacun-loadgen: network load generator for a cache server speaking the
+// memcached text protocol or RESP (Redis).
+//
+// Every thread drives its own connections from one epoll loop. With --rate
+// the load is open loop: requests are due on a fixed schedule (or Poisson
+// arrivals with --poisson) whether or not the server keeps up, and latency
+// is measured from the time a request was due, not from when a free
+// connection finally sent it. A slow server therefore shows up as queueing
+// in the percentiles instead of silently lowering the offered load
+// (coordinated omission). Without --rate every connection keeps --pipeline
+// requests in flight (closed loop) and latency is measured from the send.
+//
+// Build (see README):
+//   cc -O2 -pthread -DLAHMACUN_NO_MAIN -DLAHMACUN_QUIET lahmacun-loadgen.c lahmacun[a-z]*.c -lm -o lahmacun-loadgen
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "lahmacunhist.h"
+
+#define MAX_PIPELINE 1024
+#define IN_BUFFER_SIZE (64 * 1024)
+#define MAX_EVENTS 64
+#define DRAIN_NS 2000000000ull
+
+typedef enum
+{
+    PROTO_MEMCACHE,
+    PROTO_RESP
+} Protocol;
+
+typedef enum
+{
+    REQ_GET,
+    REQ_SET,
+    REQ_COUNT
+} RequestKind;
+
+typedef enum
+{
+    REPLY_HIT,
+    REPLY_MISS,
+    REPLY_STORED,
+    REPLY_ERROR
+} ReplyKind;
+
+static const char *request_names[REQ_COUNT] = {"get", "set"};
+
+typedef struct
+{
+    const char *host;
+    const char *port;
+    Protocol protocol;
+    int threads;
+    int connections; // per thread
+    int pipeline;
+    double rate; // requests per second over all threads, 0 = closed loop
+    int poisson;
+    double duration;
+    uint64_t keys;
+    int value_size;
+    int ttl;
+    double get_ratio;
+    int preload;
+    const char *hgrm_prefix;
+} LoadConfig;
+
+typedef struct
+{
+    int fd;
+    char *out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    int watching_out;
+    char in[IN_BUFFER_SIZE];
+    size_t in_len;
+    // in-flight requests, oldest first: the server answers in order
+    uint64_t intended[MAX_PIPELINE];
+    uint8_t kind[MAX_PIPELINE];
+    unsigned int head;
+    unsigned int outstanding;
+} Connection;
+
+typedef struct
+{
+    const LoadConfig *cfg;
+    int id;
+    int epfd;
+    Connection *conns;
+    unsigned int next_conn;
+    uint64_t rng;
+    char *value;
+    uint64_t preload_next; // next key to preload, stepping by threads
+    int recording;
+    Histogram hist[REQ_COUNT]; // nanoseconds from intended send time
+    uint64_t sent;
+    uint64_t completed[REQ_COUNT];
+    uint64_t hits;
+    uint64_t errors;
+    uint64_t unfinished;
+    uint64_t max_lag_ns; // worst gap between a request being due and being written
+    int failed;
+} LoadWorker;
+
+static uint64_t nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*
+static uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+static double nextUnit(uint64_t *state)
+{
+    return (double)(nextRandom(state) >> 11) / 9007199254740992.0;
+}
+
+static int connectServer(const LoadConfig *cfg)
+{
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(cfg->host, cfg->port, &hints, &res) != 0)
+    {
+        return -1;
+    }
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void appendOut(Connection *c, const char *data, size_t len)
+{
+    if (c->out_len + len > c->out_cap)
+    {
+        c->out_cap = (c->out_len + len) * 2;
+        c->out = realloc(c->out, c->out_cap);
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+static void appendRequest(LoadWorker *w, Connection *c, RequestKind kind, uint64_t key_id)
+{
+    const LoadConfig *cfg = w->cfg;
+    char key[32];
+    char header[128];
+    int key_len = snprintf(key, sizeof(key), "key:%llu", (unsigned long long)key_id);
+    int n;
+    if (cfg->protocol == PROTO_MEMCACHE)
+    {
+        if (kind == REQ_GET)
+        {
+            n = snprintf(header, sizeof(header), "get %s\r\n", key);
+            appendOut(c, header, (size_t)n);
+            return;
+        }
+        n = snprintf(header, sizeof(header), "set %s 0 %d %d\r\n", key, cfg->ttl, cfg->value_size);
+        appendOut(c, header, (size_t)n);
+        appendOut(c, w->value, (size_t)cfg->value_size);
+        appendOut(c, "\r\n", 2);
+        return;
+    }
+    if (kind == REQ_GET)
+    {
+        n = snprintf(header, sizeof(header), "*2\r\n$3\r\nGET\r\n$%d\r\n%s\r\n", key_len, key);
+        appendOut(c, header, (size_t)n);
+        return;
+    }
+    n = snprintf(header, sizeof(header), "*%d\r\n$3\r\nSET\r\n$%d\r\n%s\r\n$%d\r\n",
+                 cfg->ttl > 0 ? 5 : 3, key_len, key, cfg->value_size);
+    appendOut(c, header, (size_t)n);
+    appendOut(c, w->value, (size_t)cfg->value_size);
+    appendOut(c, "\r\n", 2);
+    if (cfg->ttl > 0)
+    {
+        char ttl[16];
+        int ttl_len = snprintf(ttl, sizeof(ttl), "%d", cfg->ttl);
+        n = snprintf(header, sizeof(header), "$2\r\nEX\r\n$%d\r\n%s\r\n", ttl_len, ttl);
+        appendOut(c, header, (size_t)n);
+    }
+}
+
+// Queues one request on c; it goes out with the next flush
+static void issueRequest(LoadWorker *w, Connection *c, uint64_t intended)
+{
+    const LoadConfig *cfg = w->cfg;
+    RequestKind kind;
+    uint64_t key_id;
+    if (!w->recording)
+    {
+        kind = REQ_SET;
+        key_id = w->preload_next;
+        w->preload_next += (uint64_t)cfg->threads;
+    }
+    else
+    {
+        kind = nextUnit(&w->rng) < cfg->get_ratio ? REQ_GET : REQ_SET;
+        key_id = nextRandom(&w->rng) % cfg->keys;
+    }
+    appendRequest(w, c, kind, key_id);
+    unsigned int slot = (c->head + c->outstanding) % MAX_PIPELINE;
+    c->intended[slot] = intended;
+    c->kind[slot] = (uint8_t)kind;
+    c->outstanding++;
+    w->sent += (uint64_t)w->recording;
+}
+
+static int flushConnection(LoadWorker *w, Connection *c)
+{
+    while (c->out_sent < c->out_len)
+    {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        c->out_sent += (size_t)n;
+    }
+    if (c->out_sent == c->out_len)
+    {
+        c->out_sent = c->out_len = 0;
+    }
+    int want_out = c->out_len > 0;
+    if (want_out != c->watching_out)
+    {
+        struct epoll_event ev = {.events = EPOLLIN | (want_out ? EPOLLOUT : 0), .data.ptr = c};
+        epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->watching_out = want_out;
+    }
+    return 0;
+}
+
+static const char *findCrlf(const char *buf, size_t len)
+{
+    for (size_t i = 0; i + 1 < len; i++)
+    {
+        if (buf[i] == '\r' && buf[i + 1] == '\n')
+        {
+            return buf + i;
+        }
+    }
+    return NULL;
+}
+
+// Bytes taken by the first complete reply in buf, 0 if it is incomplete,
+// -1 if it cannot be parsed
+static long parseReply(Protocol protocol, const char *buf, size_t len, ReplyKind *kind)
+{
+    const char *eol = findCrlf(buf, len);
+    if (!eol)
+    {
+        return 0;
+    }
+    size_t line = (size_t)(eol - buf) + 2;
+    if (protocol == PROTO_MEMCACHE)
+    {
+        if (line >= 6 && !memcmp(buf, "VALUE ", 6))
+        {
+            // VALUE <key> <flags> <bytes>\r\n<data>\r\nEND\r\n
+            const char *bytes = eol;
+            while (bytes > buf && bytes[-1] != ' ')
+            {
+                bytes--;
+            }
+            size_t total = line + strtoull(bytes, NULL, 10) + 2 + 5;
+            if (len < total)
+            {
+                return 0;
+            }
+            *kind = REPLY_HIT;
+            return (long)total;
+        }
+        if (line == 5 && !memcmp(buf, "END", 3))
+        {
+            *kind = REPLY_MISS;
+        }
+        else if ((line >= 7 && !memcmp(buf, "ERROR", 5)) || (line >= 14 && !memcmp(buf + 6, "_ERROR", 6)))
+        {
+            *kind = REPLY_ERROR;
+        }
+        else
+        {
+            *kind = REPLY_STORED;
+        }
+        return (long)line;
+    }
+    switch (buf[0])
+    {
+    case '+':
+    case ':':
+        *kind = REPLY_STORED;
+        return (long)line;
+    case '-':
+        *kind = REPLY_ERROR;
+        return (long)line;
+    case '$':
+    {
+        long size = strtol(buf + 1, NULL, 10);
+        if (size < 0)
+        {
+            *kind = REPLY_MISS;
+            return (long)line;
+        }
+        if (len < line + (size_t)size + 2)
+        {
+            return 0;
+        }
+        *kind = REPLY_HIT;
+        return (long)(line + (size_t)size + 2);
+    }
+    default:
+        return -1;
+    }
+}
+
+static int readConnection(LoadWorker *w, Connection *c)
+{
+    for (;;)
+    {
+        ssize_t n = recv(c->fd, c->in + c->in_len, IN_BUFFER_SIZE - c->in_len, 0);
+        if (n == 0)
+        {
+            return -1;
+        }
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        c->in_len += (size_t)n;
+        uint64_t now = nowNanos();
+        size_t pos = 0;
+        for (;;)
+        {
+            ReplyKind kind;
+            long used = parseReply(w->cfg->protocol, c->in + pos, c->in_len - pos, &kind);
+            if (used < 0 || (used > 0 && c->outstanding == 0))
+            {
+                return -1;
+            }
+            if (used == 0)
+            {
+                break;
+            }
+            pos += (size_t)used;
+            unsigned int slot = c->head;
+            c->head = (c->head + 1) % MAX_PIPELINE;
+            c->outstanding--;
+            if (!w->recording)
+            {
+                continue;
+            }
+            int req = c->kind[slot];
+            w->completed[req]++;
+            w->hits += kind == REPLY_HIT;
+            w->errors += kind == REPLY_ERROR;
+            histRecord(&w->hist[req], now - c->intended[slot]);
+        }
+        memmove(c->in, c->in + pos, c->in_len - pos);
+        c->in_len -= pos;
+        if (c->in_len == IN_BUFFER_SIZE)
+        {
+            return -1; // a single reply larger than the buffer
+        }
+    }
+}
+
+// Next connection with room in its pipeline, round robin, or NULL
+static Connection *freeConnection(LoadWorker *w)
+{
+    int count = w->cfg->connections;
+    for (int i = 0; i < count; i++)
+    {
+        Connection *c = &w->conns[(w->next_conn + (unsigned int)i) % (unsigned int)count];
+        if (c->outstanding < (unsigned int)w->cfg->pipeline)
+        {
+            w->next_conn = (w->next_conn + (unsigned int)i + 1) % (unsigned int)count;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static int pollConnections(LoadWorker *w, int timeout_ms)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(w->epfd, events, MAX_EVENTS, timeout_ms);
+    for (int i = 0; i < n; i++)
+    {
+        Connection *c = events[i].data.ptr;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+        {
+            return -1;
+        }
+        if ((events[i].events & EPOLLIN) && readConnection(w, c) != 0)
+        {
+            return -1;
+        }
+        if ((events[i].events & EPOLLOUT) && flushConnection(w, c) != 0)
+        {
+            return -1;
+        }
+    }
+    return n < 0 && errno != EINTR ? -1 : 0;
+}
+
+static int flushAll(LoadWorker *w)
+{
+    for (int i = 0; i < w->cfg->connections; i++)
+    {
+        if (w->conns[i].out_len && flushConnection(w, &w->conns[i]) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t outstanding(const LoadWorker *w)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < w->cfg->connections; i++)
+    {
+        total += w->conns[i].outstanding;
+    }
+    return total;
+}
+
+// Sets this thread's share of the key space, pipelined, unrecorded
+static int preloadKeys(LoadWorker *w)
+{
+    w->recording = 0;
+    w->preload_next = (uint64_t)w->id;
+    while (w->preload_next < w->cfg->keys || outstanding(w))
+    {
+        Connection *c;
+        while (w->preload_next < w->cfg->keys && (c = freeConnection(w)))
+        {
+            issueRequest(w, c, 0);
+        }
+        if (flushAll(w) != 0 || pollConnections(w, 100) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int runLoad(LoadWorker *w, uint64_t start, uint64_t end)
+{
+    const LoadConfig *cfg = w->cfg;
+    double interval = cfg->rate > 0 ? 1e9 * cfg->threads / cfg->rate : 0;
+    // threads start a fraction of an interval apart so their schedules interleave
+    double next_due = (double)start + interval * w->id / cfg->threads;
+    w->recording = 1;
+
+    for (;;)
+    {
+        uint64_t now = nowNanos();
+        if (now >= end)
+        {
+            break;
+        }
+        int timeout_ms;
+        if (interval > 0)
+        {
+            Connection *c = NULL;
+            while ((uint64_t)next_due <= now && (c = freeConnection(w)))
+            {
+                if (now - (uint64_t)next_due > w->max_lag_ns)
+                {
+                    w->max_lag_ns = now - (uint64_t)next_due;
+                }
+                issueRequest(w, c, (uint64_t)next_due);
+                next_due += cfg->poisson ? -log(1.0 - nextUnit(&w->rng)) * interval : interval;
+            }
+            // Behind schedule with every pipeline full: only a reply helps
+            uint64_t wait = (uint64_t)next_due > now ? (uint64_t)next_due - now : 0;
+            timeout_ms = (uint64_t)next_due <= now ? 10 : (int)(wait / 1000000);
+        }
+        else
+        {
+            Connection *c;
+            while ((c = freeConnection(w)))
+            {
+                issueRequest(w, c, now);
+            }
+            timeout_ms = 10;
+        }
+        if (flushAll(w) != 0 || pollConnections(w, timeout_ms) != 0)
+        {
+            return -1;
+        }
+    }
+
+    // Collect what is still in flight, then count the rest as unfinished
+    uint64_t drain_end = nowNanos() + DRAIN_NS;
+    while (outstanding(w) && nowNanos() < drain_end)
+    {
+        if (flushAll(w) != 0 || pollConnections(w, 10) != 0)
+        {
+            return -1;
+        }
+    }
+    w->unfinished = outstanding(w);
+    return 0;
+}
+
+typedef struct
+{
+    LoadWorker *worker;
+    pthread_barrier_t *ready;
+    uint64_t *start;
+    uint64_t *end;
+} WorkerArgs;
+
+static void *loadWorker(void *arg)
+{
+    WorkerArgs *args = arg;
+    LoadWorker *w = args->worker;
+    const LoadConfig *cfg = w->cfg;
+    w->epfd = epoll_create1(0);
+    w->conns = calloc((size_t)cfg->connections, sizeof(Connection));
+    w->value = malloc((size_t)cfg->value_size + 1);
+    memset(w->value, 'v', (size_t)cfg->value_size);
+    for (int i = 0; i < cfg->connections && !w->failed; i++)
+    {
+        Connection *c = &w->conns[i];
+        c->fd = connectServer(cfg);
+        if (c->fd < 0)
+        {
+            w->failed = 1;
+            break;
+        }
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    }
+    if (!w->failed && cfg->preload && preloadKeys(w) != 0)
+    {
+        w->failed = 1;
+    }
+
+    // every thread connected (and preloaded) before the clock starts
+    pthread_barrier_wait(args->ready);
+    pthread_barrier_wait(args->ready);
+    if (!w->failed && runLoad(w, *args->start, *args->end) != 0)
+    {
+        w->failed = 1;
+    }
+
+    for (int i = 0; i < cfg->connections; i++)
+    {
+        if (w->conns[i].fd > 0)
+        {
+            close(w->conns[i].fd);
+        }
+        free(w->conns[i].out);
+    }
+    free(w->conns);
+    free(w->value);
+    close(w->epfd);
+    return NULL;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --host H          server host (default 127.0.0.1)\n"
+            "  --port P          server port (default 11211, 6379 with --protocol resp)\n"
+            "  --protocol P      memcache or resp (default memcache)\n"
+            "  --threads N       client threads, one epoll loop each (default 1)\n"
+            "  --connections N   connections per thread (default 4)\n"
+            "  --pipeline N      requests in flight per connection (default 1, max %d)\n"
+            "  --rate R          total requests/sec, open loop; 0 = closed loop (default 0)\n"
+            "  --poisson         exponential inter-arrival times instead of a fixed interval\n"
+            "  --duration S      seconds of load (default 10)\n"
+            "  --keys N          key space, keys are key:0 .. key:N-1 (default 100000)\n"
+            "  --value-size N    bytes per set (default 100)\n"
+            "  --ttl S           expiry sent with sets, 0 = none (default 0)\n"
+            "  --get-ratio X     fraction of gets, the rest are sets (default 0.9)\n"
+            "  --preload         set every key once before the measured run\n"
+            "  --hgrm PREFIX     write PREFIX.get.hgrm and PREFIX.set.hgrm (microseconds)\n",
+            prog, MAX_PIPELINE);
+}
+
+int main(int argc, char **argv)
+{
+    LoadConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.host = "127.0.0.1";
+    cfg.protocol = PROTO_MEMCACHE;
+    cfg.threads = 1;
+    cfg.connections = 4;
+    cfg.pipeline = 1;
+    cfg.duration = 10;
+    cfg.keys = 100000;
+    cfg.value_size = 100;
+    cfg.get_ratio = 0.9;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--poisson"))
+        {
+            cfg.poisson = 1;
+            continue;
+        }
+        if (!strcmp(arg, "--preload"))
+        {
+            cfg.preload = 1;
+            continue;
+        }
+        if (!val)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+        if (!strcmp(arg, "--host"))
+        {
+            cfg.host = val;
+        }
+        else if (!strcmp(arg, "--port"))
+        {
+            cfg.port = val;
+        }
+        else if (!strcmp(arg, "--protocol"))
+        {
+            if (!strcmp(val, "memcache") || !strcmp(val, "memcached"))
+            {
+                cfg.protocol = PROTO_MEMCACHE;
+            }
+            else if (!strcmp(val, "resp") || !strcmp(val, "redis"))
+            {
+                cfg.protocol = PROTO_RESP;
+            }
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "--threads"))
+        {
+            cfg.threads = atoi(val);
+        }
+        else if (!strcmp(arg, "--connections"))
+        {
+            cfg.connections = atoi(val);
+        }
+        else if (!strcmp(arg, "--pipeline"))
+        {
+            cfg.pipeline = atoi(val);
+        }
+        else if (!strcmp(arg, "--rate"))
+        {
+            cfg.rate = atof(val);
+        }
+        else if (!strcmp(arg, "--duration"))
+        {
+            cfg.duration = atof(val);
+        }
+        else if (!strcmp(arg, "--keys"))
+        {
+            cfg.keys = strtoull(val, NULL, 10);
+        }
+        else if (!strcmp(arg, "--value-size"))
+        {
+            cfg.value_size = atoi(val);
+        }
+        else if (!strcmp(arg, "--ttl"))
+        {
+            cfg.ttl = atoi(val);
+        }
+        else if (!strcmp(arg, "--get-ratio"))
+        {
+            cfg.get_ratio = atof(val);
+        }
+        else if (!strcmp(arg, "--hgrm"))
+        {
+            cfg.hgrm_prefix = val;
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!cfg.port)
+    {
+        cfg.port = cfg.protocol == PROTO_RESP ? "6379" : "11211";
+    }
+    if (cfg.threads < 1 || cfg.connections < 1 || cfg.pipeline < 1 || cfg.pipeline > MAX_PIPELINE ||
+        cfg.rate < 0 || cfg.duration <= 0 || cfg.keys < 1 || cfg.value_size < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LoadWorker *workers = calloc((size_t)cfg.threads, sizeof(LoadWorker));
+    WorkerArgs *args = calloc((size_t)cfg.threads, sizeof(WorkerArgs));
+    pthread_t *tids = malloc((size_t)cfg.threads * sizeof(pthread_t));
+    pthread_barrier_t ready;
+    pthread_barrier_init(&ready, NULL, (unsigned int)cfg.threads + 1);
+    uint64_t start = 0, end = 0;
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        workers[t].cfg = &cfg;
+        workers[t].id = t;
+        workers[t].rng = 0x9e3779b97f4a7c15ull * (uint64_t)(t + 1);
+        args[t] = (WorkerArgs){&workers[t], &ready, &start, &end};
+        pthread_create(&tids[t], NULL, loadWorker, &args[t]);
+    }
+    pthread_barrier_wait(&ready);
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        if (workers[t].failed)
+        {
+            fprintf(stderr, "cannot connect to %s:%s\n", cfg.host, cfg.port);
+            return 1;
+        }
+    }
+    start = nowNanos();
+    end = start + (uint64_t)(cfg.duration * 1e9);
+    pthread_barrier_wait(&ready);
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        pthread_join(tids[t], NULL);
+    }
+    pthread_barrier_destroy(&ready);
+
+    uint64_t sent = 0, completed = 0, hits = 0, errors = 0, unfinished = 0, lag = 0, gets = 0;
+    int failed = 0;
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        LoadWorker *w = &workers[t];
+        sent += w->sent;
+        completed += w->completed[REQ_GET] + w->completed[REQ_SET];
+        gets += w->completed[REQ_GET];
+        hits += w->hits;
+        errors += w->errors;
+        unfinished += w->unfinished;
+        lag = w->max_lag_ns > lag ? w->max_lag_ns : lag;
+        failed |= w->failed;
+    }
+    printf("%s %s:%s, %d threads x %d connections, pipeline %d, %s\n",
+           cfg.protocol == PROTO_RESP ? "resp" : "memcache", cfg.host, cfg.port,
+           cfg.threads, cfg.connections, cfg.pipeline, cfg.rate > 0 ? "open loop" : "closed loop");
+    if (cfg.rate > 0)
+    {
+        printf("offered: %.0f req/s%s\n", cfg.rate, cfg.poisson ? " (poisson)" : "");
+    }
+    printf("achieved: %.0f req/s, sent=%llu completed=%llu errors=%llu unfinished=%llu\n",
+           (double)completed / cfg.duration, (unsigned long long)sent, (unsigned long long)completed,
+           (unsigned long long)errors, (unsigned long long)unfinished);
+    if (gets)
+    {
+        printf("get hit ratio: %.4f\n", (double)hits / (double)gets);
+    }
+    if (cfg.rate > 0)
+    {
+        printf("max send lag: %.3f ms\n", (double)lag / 1e6);
+    }
+    if (failed)
+    {
+        fprintf(stderr, "a connection failed during the run, results are partial\n");
+    }
+
+    Histogram merged;
+    for (int req = 0; req < REQ_COUNT; req++)
+    {
+        memset(&merged, 0, sizeof(merged));
+        for (int t = 0; t < cfg.threads; t++)
+        {
+            histMerge(&merged, &workers[t].hist[req]);
+        }
+        uint64_t count = histTotal(&merged);
+        if (count == 0)
+        {
+            continue;
+        }
+        printf("%-4s ops=%llu avg=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n",
+               request_names[req], (unsigned long long)count, histMean(&merged) / 1000.0,
+               (double)histPercentile(&merged, 50) / 1000.0, (double)histPercentile(&merged, 90) / 1000.0,
+               (double)histPercentile(&merged, 99) / 1000.0, (double)histPercentile(&merged, 99.9) / 1000.0,
+               (double)histMax(&merged) / 1000.0);
+        if (cfg.hgrm_prefix)
+        {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s.%s.hgrm", cfg.hgrm_prefix, request_names[req]);
+            FILE *file = fopen(path, "w");
+            if (file)
+            {
+                histExport(&merged, file, 1000.0);
+                fclose(file);
+            }
+        }
+    }
+
+    free(tids);
+    free(args);
+    free(workers);
+    return failed;
+}
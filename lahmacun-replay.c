@@ -0,0 +1,334 @@
+// lahmacun-replay: replays a trace written by startCacheTrace against an
+// in-process Cache.
+//
+// Records are split over --threads workers by key hash, so every key keeps
+// its original operation order. Each operation is issued at its recorded
+// time divided by --speed (open loop) and its latency is measured from that
+// intended time, so a replay that falls behind shows up in the percentiles
+// instead of silently slowing down. --speed 0 replays as fast as possible.
+//
+// Build (see README):
+//   cc -O2 -pthread -DLAHMACUN_NO_MAIN -DLAHMACUN_QUIET lahmacun-replay.c lahmacun[a-z]*.c -lm -o lahmacun-replay
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacuncache.h"
+#include "lahmacunhist.h"
+#include "lahmacuntrace.h"
+
+#define SPIN_THRESHOLD_NS 50000
+
+static const char *op_names[] = {"", "GET", "SET", "DELETE"};
+
+typedef struct
+{
+    Cache *cache;
+    TraceRecord *records;
+    size_t count;
+    size_t capacity;
+    double speed;
+    uint64_t start_ns;
+    Histogram hist[4]; // nanoseconds from intended send time
+    uint64_t max_behind_ns;
+    size_t hits;
+    size_t recorded_hits;
+    size_t gets;
+} ReplayWorker;
+
+static uint64_t nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// The trace only has the key's hash and length, so keys are rebuilt as the
+// hash in hex, cut or padded to the recorded length
+static void rebuildKey(const TraceRecord *rec, char *key)
+{
+    char hex[17];
+    size_t len = rec->key_len < MAX_KEY_SIZE ? rec->key_len : MAX_KEY_SIZE - 1;
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)rec->key_hash);
+    for (size_t i = 0; i < len; i++)
+    {
+        key[i] = i < 16 ? hex[i] : '.';
+    }
+    key[len] = '\0';
+    if (len == 0)
+    {
+        key[0] = '-';
+        key[1] = '\0';
+    }
+}
+
+static void waitUntil(uint64_t target)
+{
+    uint64_t now = nowNanos();
+    if (now + SPIN_THRESHOLD_NS < target)
+    {
+        uint64_t sleep_ns = target - now - SPIN_THRESHOLD_NS;
+        struct timespec ts = {(time_t)(sleep_ns / 1000000000u), (long)(sleep_ns % 1000000000u)};
+        nanosleep(&ts, NULL);
+    }
+    while (nowNanos() < target)
+    {
+    }
+}
+
+static void *replayWorker(void *arg)
+{
+    ReplayWorker *w = arg;
+    char key[MAX_KEY_SIZE + 1];
+    char *value = malloc(MAX_VALUE_SIZE);
+    memset(value, 'r', MAX_VALUE_SIZE);
+
+    for (size_t i = 0; i < w->count; i++)
+    {
+        const TraceRecord *rec = &w->records[i];
+        rebuildKey(rec, key);
+
+        uint64_t intended;
+        if (w->speed > 0)
+        {
+            intended = w->start_ns + (uint64_t)((double)rec->timestamp_ns / w->speed);
+            waitUntil(intended);
+        }
+        else
+        {
+            intended = nowNanos();
+        }
+        uint64_t issued = nowNanos();
+        if (issued - intended > w->max_behind_ns)
+        {
+            w->max_behind_ns = issued - intended;
+        }
+
+        int op = rec->op & ~TRACE_HIT;
+        switch (op)
+        {
+        case TRACE_GET:
+            w->gets++;
+            w->recorded_hits += (rec->op & TRACE_HIT) != 0;
+            w->hits += getCache(w->cache, key) != NULL;
+            break;
+        case TRACE_SET:
+        {
+            size_t len = rec->value_size < MAX_VALUE_SIZE ? rec->value_size : MAX_VALUE_SIZE - 1;
+            char saved = value[len];
+            value[len] = '\0';
+            setCache(w->cache, key, value, rec->ttl);
+            value[len] = saved;
+            break;
+        }
+        case TRACE_DELETE:
+            deleteCache(w->cache, key);
+            break;
+        default:
+            continue;
+        }
+        histRecord(&w->hist[op], nowNanos() - intended);
+    }
+    free(value);
+    return NULL;
+}
+
+// Keys whose first traced operation is a get hit were written before the
+// trace started; insert them so the replay starts from the same state
+static void warmCache(Cache *cache, ReplayWorker *workers, int threads)
+{
+    Cache *seen = createCache();
+    char key[MAX_KEY_SIZE + 1];
+    char *value = malloc(MAX_VALUE_SIZE);
+    memset(value, 'w', MAX_VALUE_SIZE);
+    for (int t = 0; t < threads; t++)
+    {
+        for (size_t i = 0; i < workers[t].count; i++)
+        {
+            const TraceRecord *rec = &workers[t].records[i];
+            rebuildKey(rec, key);
+            if (getCache(seen, key))
+            {
+                continue;
+            }
+            setCache(seen, key, "", 3600);
+            if (rec->op == (TRACE_GET | TRACE_HIT))
+            {
+                size_t len = rec->value_size < MAX_VALUE_SIZE ? rec->value_size : MAX_VALUE_SIZE - 1;
+                value[len] = '\0';
+                setCache(cache, key, value, 3600);
+                value[len] = 'w';
+            }
+        }
+    }
+    free(value);
+    freeCache(seen);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--speed X] [--threads N] [--warm] [--dump] TRACE\n"
+            "  --speed X    replay at X times the recorded rate, 0 = as fast as possible (default 1)\n"
+            "  --threads N  replay threads, keys are partitioned by hash (default 1)\n"
+            "  --warm       insert keys first seen as get hits before replaying\n"
+            "  --dump       print the records as text instead of replaying\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 1.0;
+    int threads = 1;
+    int dump = 0;
+    int warm = 0;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+        {
+            speed = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--warm"))
+        {
+            warm = 1;
+        }
+        else if (!strcmp(argv[i], "--dump"))
+        {
+            dump = 1;
+        }
+        else if (argv[i][0] != '-' && !path)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path || threads < 1 || speed < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TraceReader reader;
+    if (traceReaderOpen(&reader, path) != 0)
+    {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        return 1;
+    }
+
+    ReplayWorker *workers = calloc((size_t)threads, sizeof(ReplayWorker));
+    TraceRecord rec;
+    size_t total = 0;
+    uint64_t duration = 0;
+    int rc;
+    while ((rc = traceReadNext(&reader, &rec)) == 1)
+    {
+        if (dump)
+        {
+            printf("%llu %s%s hash=%016llx key_len=%u value_size=%u ttl=%d\n",
+                   (unsigned long long)rec.timestamp_ns, op_names[(rec.op & ~TRACE_HIT) & 3],
+                   rec.op & TRACE_HIT ? " hit" : "", (unsigned long long)rec.key_hash,
+                   rec.key_len, rec.value_size, rec.ttl);
+            continue;
+        }
+        ReplayWorker *w = &workers[rec.key_hash % (uint64_t)threads];
+        if (w->count == w->capacity)
+        {
+            w->capacity = w->capacity ? w->capacity * 2 : 4096;
+            w->records = realloc(w->records, w->capacity * sizeof(TraceRecord));
+        }
+        w->records[w->count++] = rec;
+        total++;
+        duration = rec.timestamp_ns;
+    }
+    if (rc < 0)
+    {
+        fprintf(stderr, "%s: truncated record after %zu records, replaying what was read\n", path, total);
+    }
+    unsigned int sample_rate = reader.sample_rate;
+    traceReaderClose(&reader);
+    if (dump)
+    {
+        free(workers);
+        return 0;
+    }
+
+    Cache *cache = createCache();
+    if (warm)
+    {
+        warmCache(cache, workers, threads);
+    }
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    uint64_t start = nowNanos() + 1000000; // let every thread reach its first record
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].cache = cache;
+        workers[t].speed = speed;
+        workers[t].start_ns = start;
+        pthread_create(&tids[t], NULL, replayWorker, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(tids[t], NULL);
+    }
+    double seconds = (double)(nowNanos() - start) / 1e9;
+
+    printf("records: %zu (sample rate 1/%u), recorded duration: %.3f s\n",
+           total, sample_rate, (double)duration / 1e9);
+    printf("replay: %.3f s at speed %g, %.0f ops/sec\n", seconds, speed, (double)total / seconds);
+
+    uint64_t behind = 0;
+    size_t gets = 0, hits = 0, recorded_hits = 0;
+    for (int op = TRACE_GET; op <= TRACE_DELETE; op++)
+    {
+        Histogram merged;
+        memset(&merged, 0, sizeof(merged));
+        for (int t = 0; t < threads; t++)
+        {
+            histMerge(&merged, &workers[t].hist[op]);
+        }
+        uint64_t count = histTotal(&merged);
+        if (count == 0)
+        {
+            continue;
+        }
+        printf("%-6s ops=%llu avg=%.3fus p50=%.3fus p99=%.3fus p999=%.3fus max=%.3fus\n",
+               op_names[op], (unsigned long long)count,
+               histMean(&merged) / 1000.0,
+               (double)histPercentile(&merged, 50) / 1000.0,
+               (double)histPercentile(&merged, 99) / 1000.0,
+               (double)histPercentile(&merged, 99.9) / 1000.0,
+               (double)histMax(&merged) / 1000.0);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        behind = workers[t].max_behind_ns > behind ? workers[t].max_behind_ns : behind;
+        gets += workers[t].gets;
+        hits += workers[t].hits;
+        recorded_hits += workers[t].recorded_hits;
+        free(workers[t].records);
+    }
+    if (gets)
+    {
+        printf("get hit ratio: replayed %.4f, recorded %.4f\n",
+               (double)hits / (double)gets, (double)recorded_hits / (double)gets);
+    }
+    printf("max schedule lag: %.3f us\n", (double)behind / 1000.0);
+
+    free(tids);
+    free(workers);
+    freeCache(cache);
+    return 0;
+}
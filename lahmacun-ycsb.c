@@ -0,0 +1,871 @@
+// lahmacun-ycsb: YCSB core workloads A-F against an in-process Cache.
+//
+// Load phase inserts --records keys, the run phase issues --ops operations
+// drawn from the workload's read/update/insert/scan/read-modify-write mix
+// with a zipfian, latest or uniform key chooser. Results are printed in
+// YCSB's "[OP], metric, value" format.
+//
+// Build (see README):
+//   cc -O2 -pthread -DLAHMACUN_NO_MAIN -DLAHMACUN_QUIET lahmacun-ycsb.c lahmacun[a-z]*.c -lm -o lahmacun-ycsb
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacuncache.h"
+#include "lahmacunsplit.h"
+#include "lahmacuncuckoo.h"
+#include "lahmacunrobin.h"
+#include "lahmacunint.h"
+#include "lahmacunhist.h"
+
+#define YCSB_KEY_SIZE 32
+#define ZIPFIAN_CONSTANT 0.99
+
+typedef enum
+{
+    YCSB_READ,
+    YCSB_UPDATE,
+    YCSB_INSERT,
+    YCSB_SCAN,
+    YCSB_RMW,
+    YCSB_OP_COUNT
+} YcsbOp;
+
+static const char *ycsb_op_names[] = {"READ", "UPDATE", "INSERT", "SCAN", "READ-MODIFY-WRITE"};
+
+typedef enum
+{
+    DIST_UNIFORM,
+    DIST_ZIPFIAN,
+    DIST_LATEST
+} KeyDistribution;
+
+typedef enum
+{
+    SIZE_FIXED,
+    SIZE_UNIFORM,
+    SIZE_ZIPFIAN
+} SizeDistribution;
+
+typedef enum
+{
+    ENGINE_CHAINED, // Cache
+    ENGINE_SPLIT,   // SplitCache
+    ENGINE_CUCKOO,  // CuckooCache
+    ENGINE_ROBIN,   // RobinCache
+    ENGINE_INT      // IntCache, keyed by the number behind each "user<n>" key
+} TableEngine;
+
+typedef struct
+{
+    double proportions[YCSB_OP_COUNT];
+    KeyDistribution key_dist;
+    SizeDistribution size_dist;
+    TableEngine engine;
+    size_t min_value_size;
+    size_t max_value_size;
+    size_t max_scan_length;
+    size_t records;
+    size_t ops;
+    int threads;
+    double theta;
+    const char *trace_path;
+    unsigned int trace_sample;
+    int stats;
+    size_t near_cache_slots;
+    int hot_replicas;
+    int flat_combining;
+    int shards;
+    int optimistic_reads;
+    int numa;       // shards on NUMA nodes, client threads pinned round robin
+    int numa_local; // and each thread's keys on its own node's shards
+} YcsbConfig;
+
+// YCSB's ZipfianGenerator (Gray et al., "Quickly generating billion-record
+// synthetic databases"); zetan is extended incrementally as items grows.
+typedef struct
+{
+    double theta;
+    double alpha;
+    double zeta2;
+    double zetan;
+    double eta;
+    size_t items;
+} Zipfian;
+
+typedef struct
+{
+    Cache *cache;
+    SplitCache *split;
+    CuckooCache *cuckoo;
+    RobinCache *robin;
+    IntCache *ints;
+    const YcsbConfig *cfg;
+    size_t first;
+    size_t ops;
+    uint64_t rng;
+    Zipfian zipf;
+    Zipfian size_zipf;
+    char *value;
+    Histogram hist[YCSB_OP_COUNT]; // nanoseconds
+    size_t hits;
+    size_t misses;
+    int node; // pinned to with --numa, else -1
+} YcsbWorker;
+
+// Inserted key count, shared by all run-phase threads
+static size_t insert_counter;
+
+static uint64_t nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64*
+static uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ull;
+}
+
+static double nextDouble(uint64_t *state)
+{
+    return (double)(nextRandom(state) >> 11) / (double)(1ull << 53);
+}
+
+static uint64_t fnv1a64(uint64_t v)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (int i = 0; i < 8; i++)
+    {
+        h ^= v & 0xff;
+        h *= 1099511628211ull;
+        v >>= 8;
+    }
+    return h;
+}
+
+static double zeta(size_t from, size_t to, double theta, double initial)
+{
+    double sum = initial;
+    for (size_t i = from; i < to; i++)
+    {
+        sum += 1.0 / pow((double)(i + 1), theta);
+    }
+    return sum;
+}
+
+static void zipfianInit(Zipfian *z, size_t items, double theta)
+{
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zeta2 = zeta(0, 2, theta, 0);
+    z->zetan = zeta(0, items, theta, 0);
+    z->items = items;
+    z->eta = (1 - pow(2.0 / (double)items, 1 - theta)) / (1 - z->zeta2 / z->zetan);
+}
+
+// Rank in [0, items), 0 being the most popular
+static size_t zipfianNext(Zipfian *z, uint64_t *rng, size_t items)
+{
+    if (items > z->items)
+    {
+        z->zetan = zeta(z->items, items, z->theta, z->zetan);
+        z->items = items;
+        z->eta = (1 - pow(2.0 / (double)items, 1 - z->theta)) / (1 - z->zeta2 / z->zetan);
+    }
+    double u = nextDouble(rng);
+    double uz = u * z->zetan;
+    if (uz < 1.0)
+    {
+        return 0;
+    }
+    if (uz < 1.0 + pow(0.5, z->theta))
+    {
+        return items > 1 ? 1 : 0;
+    }
+    size_t rank = (size_t)((double)items * pow(z->eta * u - z->eta + 1, z->alpha));
+    return rank < items ? rank : items - 1;
+}
+
+// Hashed like YCSB's "user<hash>" so neighbouring ordinals do not share buckets
+static inline uint64_t keyId(size_t ordinal)
+{
+    return fnv1a64(ordinal) % 100000000000ull;
+}
+
+static void buildKey(size_t ordinal, char *key)
+{
+    snprintf(key, YCSB_KEY_SIZE, "user%llu", (unsigned long long)keyId(ordinal));
+}
+
+static size_t chooseKey(YcsbWorker *w)
+{
+    size_t items = __atomic_load_n(&insert_counter, __ATOMIC_RELAXED);
+    switch (w->cfg->key_dist)
+    {
+    case DIST_UNIFORM:
+        return nextRandom(&w->rng) % items;
+    case DIST_ZIPFIAN:
+        // Scrambled zipfian: popular ranks are spread over the key space
+        return fnv1a64(zipfianNext(&w->zipf, &w->rng, items)) % items;
+    case DIST_LATEST:
+        return items - 1 - zipfianNext(&w->zipf, &w->rng, items);
+    }
+    return 0;
+}
+
+static size_t chooseValueSize(YcsbWorker *w)
+{
+    const YcsbConfig *cfg = w->cfg;
+    size_t span = cfg->max_value_size - cfg->min_value_size + 1;
+    switch (cfg->size_dist)
+    {
+    case SIZE_FIXED:
+        return cfg->max_value_size;
+    case SIZE_UNIFORM:
+        return cfg->min_value_size + nextRandom(&w->rng) % span;
+    case SIZE_ZIPFIAN:
+        return cfg->min_value_size + zipfianNext(&w->size_zipf, &w->rng, span);
+    }
+    return cfg->max_value_size;
+}
+
+// Fills w->value with value_size - 1 random printable characters
+static const char *makeValue(YcsbWorker *w)
+{
+    size_t len = chooseValueSize(w);
+    for (size_t i = 0; i + 1 < len; i += 8)
+    {
+        uint64_t r = nextRandom(&w->rng);
+        for (size_t j = 0; j < 8 && i + j + 1 < len; j++)
+        {
+            w->value[i + j] = (char)('!' + (r >> (j * 8)) % 94);
+        }
+    }
+    w->value[len - 1] = '\0';
+    return w->value;
+}
+
+static YcsbOp chooseOp(YcsbWorker *w)
+{
+    double r = nextDouble(&w->rng);
+    for (int op = 0; op < YCSB_OP_COUNT; op++)
+    {
+        if (r < w->cfg->proportions[op])
+        {
+            return (YcsbOp)op;
+        }
+        r -= w->cfg->proportions[op];
+    }
+    return YCSB_READ;
+}
+
+static int engineGet(YcsbWorker *w, size_t ordinal)
+{
+    char value[MAX_VALUE_SIZE];
+    if (w->cfg->engine == ENGINE_INT)
+    {
+        return getIntCache(w->ints, keyId(ordinal), value, sizeof(value)) >= 0;
+    }
+    char key[YCSB_KEY_SIZE];
+    buildKey(ordinal, key);
+    switch (w->cfg->engine)
+    {
+    case ENGINE_SPLIT:
+        return getSplitCache(w->split, key, value, sizeof(value)) >= 0;
+    case ENGINE_CUCKOO:
+        return getCuckooCache(w->cuckoo, key, value, sizeof(value)) >= 0;
+    case ENGINE_ROBIN:
+        return getRobinCache(w->robin, key, value, sizeof(value)) >= 0;
+    default:
+        if (w->cfg->optimistic_reads || w->cfg->hot_replicas)
+        {
+            return getCacheCopy(w->cache, key, value, sizeof(value)) >= 0;
+        }
+        return getCache(w->cache, key) != NULL;
+    }
+}
+
+static void engineSet(YcsbWorker *w, size_t ordinal, const char *value)
+{
+    if (w->cfg->engine == ENGINE_INT)
+    {
+        setIntCache(w->ints, keyId(ordinal), value, 3600);
+        return;
+    }
+    char key[YCSB_KEY_SIZE];
+    buildKey(ordinal, key);
+    switch (w->cfg->engine)
+    {
+    case ENGINE_SPLIT:
+        setSplitCache(w->split, key, value, 3600);
+        break;
+    case ENGINE_CUCKOO:
+        setCuckooCache(w->cuckoo, key, value, 3600);
+        break;
+    case ENGINE_ROBIN:
+        setRobinCache(w->robin, key, value, 3600);
+        break;
+    default:
+        setCache(w->cache, key, value, 3600);
+        break;
+    }
+}
+
+static void doRead(YcsbWorker *w, size_t ordinal)
+{
+    if (engineGet(w, ordinal))
+    {
+        w->hits++;
+    }
+    else
+    {
+        w->misses++;
+    }
+}
+
+static void doWrite(YcsbWorker *w, size_t ordinal)
+{
+    engineSet(w, ordinal, makeValue(w));
+}
+
+static void *runWorker(void *arg)
+{
+    YcsbWorker *w = arg;
+    numaPinThread(w->node);
+    for (size_t i = 0; i < w->ops; i++)
+    {
+        YcsbOp op = chooseOp(w);
+        uint64_t start = nowNanos();
+        switch (op)
+        {
+        case YCSB_READ:
+            doRead(w, chooseKey(w));
+            break;
+        case YCSB_UPDATE:
+            doWrite(w, chooseKey(w));
+            break;
+        case YCSB_INSERT:
+            doWrite(w, __atomic_fetch_add(&insert_counter, 1, __ATOMIC_RELAXED));
+            break;
+        case YCSB_SCAN:
+        {
+            // The cache has no ordered iteration; a scan reads a run of
+            // consecutive ordinals starting at the chosen key instead.
+            size_t first = chooseKey(w);
+            size_t len = 1 + nextRandom(&w->rng) % w->cfg->max_scan_length;
+            size_t items = __atomic_load_n(&insert_counter, __ATOMIC_RELAXED);
+            for (size_t k = 0; k < len && first + k < items; k++)
+            {
+                doRead(w, first + k);
+            }
+            break;
+        }
+        case YCSB_RMW:
+        {
+            size_t ordinal = chooseKey(w);
+            doRead(w, ordinal);
+            doWrite(w, ordinal);
+            break;
+        }
+        default:
+            break;
+        }
+        histRecord(&w->hist[op], nowNanos() - start);
+    }
+    return NULL;
+}
+
+static void *loadWorker(void *arg)
+{
+    YcsbWorker *w = arg;
+    numaPinThread(w->node);
+    for (size_t i = 0; i < w->ops; i++)
+    {
+        size_t ordinal = w->first + i;
+        uint64_t start = nowNanos();
+        engineSet(w, ordinal, w->value);
+        histRecord(&w->hist[YCSB_INSERT], nowNanos() - start);
+    }
+    return NULL;
+}
+
+static void report(const char *phase, YcsbWorker *workers, int threads, double seconds, size_t ops)
+{
+    printf("[OVERALL], Phase, %s\n", phase);
+    printf("[OVERALL], RunTime(ms), %.0f\n", seconds * 1000.0);
+    printf("[OVERALL], Throughput(ops/sec), %.2f\n", (double)ops / seconds);
+
+    size_t hits = 0, misses = 0;
+    for (int op = 0; op < YCSB_OP_COUNT; op++)
+    {
+        Histogram merged;
+        memset(&merged, 0, sizeof(merged));
+        for (int t = 0; t < threads; t++)
+        {
+            histMerge(&merged, &workers[t].hist[op]);
+        }
+        uint64_t total = histTotal(&merged);
+        if (total == 0)
+        {
+            continue;
+        }
+        const char *name = ycsb_op_names[op];
+        printf("[%s], Operations, %llu\n", name, (unsigned long long)total);
+        printf("[%s], AverageLatency(us), %.3f\n", name, histMean(&merged) / 1000.0);
+        printf("[%s], 50thPercentileLatency(us), %.3f\n", name, (double)histPercentile(&merged, 50) / 1000.0);
+        printf("[%s], 95thPercentileLatency(us), %.3f\n", name, (double)histPercentile(&merged, 95) / 1000.0);
+        printf("[%s], 99thPercentileLatency(us), %.3f\n", name, (double)histPercentile(&merged, 99) / 1000.0);
+        printf("[%s], 99.9thPercentileLatency(us), %.3f\n", name, (double)histPercentile(&merged, 99.9) / 1000.0);
+        printf("[%s], MaxLatency(us), %.3f\n", name, (double)histMax(&merged) / 1000.0);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        hits += workers[t].hits;
+        misses += workers[t].misses;
+    }
+    if (hits + misses)
+    {
+        printf("[READ], HitRatio, %.4f\n", (double)hits / (double)(hits + misses));
+    }
+}
+
+static double runPhase(YcsbWorker *workers, int threads, void *(*fn)(void *))
+{
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    uint64_t start = nowNanos();
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_create(&tids[t], NULL, fn, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        pthread_join(tids[t], NULL);
+    }
+    free(tids);
+    return (double)(nowNanos() - start) / 1e9;
+}
+
+static int applyWorkload(YcsbConfig *cfg, char name)
+{
+    memset(cfg->proportions, 0, sizeof(cfg->proportions));
+    cfg->key_dist = DIST_ZIPFIAN;
+    switch (name)
+    {
+    case 'a': // update heavy
+        cfg->proportions[YCSB_READ] = 0.5;
+        cfg->proportions[YCSB_UPDATE] = 0.5;
+        return 0;
+    case 'b': // read mostly
+        cfg->proportions[YCSB_READ] = 0.95;
+        cfg->proportions[YCSB_UPDATE] = 0.05;
+        return 0;
+    case 'c': // read only
+        cfg->proportions[YCSB_READ] = 1.0;
+        return 0;
+    case 'd': // read latest
+        cfg->proportions[YCSB_READ] = 0.95;
+        cfg->proportions[YCSB_INSERT] = 0.05;
+        cfg->key_dist = DIST_LATEST;
+        return 0;
+    case 'e': // short ranges
+        cfg->proportions[YCSB_SCAN] = 0.95;
+        cfg->proportions[YCSB_INSERT] = 0.05;
+        return 0;
+    case 'f': // read-modify-write
+        cfg->proportions[YCSB_READ] = 0.5;
+        cfg->proportions[YCSB_RMW] = 0.5;
+        return 0;
+    }
+    return -1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --workload a|b|c|d|e|f     YCSB core workload preset (default a)\n"
+            "  --readprop/--updateprop/--insertprop/--scanprop/--rmwprop P\n"
+            "                             override one proportion of the mix\n"
+            "  --distribution zipfian|latest|uniform\n"
+            "  --theta T                  zipfian constant (default 0.99)\n"
+            "  --records N                keys inserted by the load phase (default 100000)\n"
+            "  --ops N                    run phase operations (default 200000)\n"
+            "  --threads N                client threads (default 1)\n"
+            "  --value-size N | MIN-MAX   value size in bytes including NUL (default 100)\n"
+            "  --value-dist fixed|uniform|zipfian\n"
+            "  --max-scan N               longest scan (default 100)\n"
+            "  --trace FILE               record the run phase for lahmacun-replay\n"
+            "  --trace-sample N           trace 1 in N keys (default 1)\n"
+            "  --near-cache N             per-thread near cache of N slots (default 0, off)\n"
+            "  --hot-replicas             per-CPU read copies of detected hot keys, read\n"
+            "                             with getCacheCopy\n"
+            "  --flat-combining           batch concurrent writes under one lock acquisition\n"
+            "  --shards N                 hand the table to N owner threads (default 0, off)\n"
+            "  --optimistic-reads         copy values out with getCacheCopy's lock-free path\n"
+            "  --numa                     place shards on NUMA nodes and pin client threads\n"
+            "                             round robin to the nodes (needs --shards)\n"
+            "  --numa-local               --numa, routing each thread to its node's shards;\n"
+            "                             every node then loads its own copy of the records\n"
+            "  --engine chained|split|cuckoo|robinhood|int\n"
+            "                             table: Cache (default), the lock-free SplitCache,\n"
+            "                             the optimistic CuckooCache, the open addressing\n"
+            "                             RobinCache or IntCache with the keys' numbers; the\n"
+            "                             Cache options above only apply to chained\n"
+            "  --stats                    turn on latency histograms and lock profiling and\n"
+            "                             print the cache's stats report at the end\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    YcsbConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    applyWorkload(&cfg, 'a');
+    cfg.size_dist = SIZE_FIXED;
+    cfg.min_value_size = 100;
+    cfg.max_value_size = 100;
+    cfg.max_scan_length = 100;
+    cfg.records = 100000;
+    cfg.ops = 200000;
+    cfg.threads = 1;
+    cfg.theta = ZIPFIAN_CONSTANT;
+    cfg.trace_sample = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--stats"))
+        {
+            cfg.stats = 1;
+            continue;
+        }
+        if (!strcmp(arg, "--hot-replicas"))
+        {
+            cfg.hot_replicas = 1;
+            continue;
+        }
+        if (!strcmp(arg, "--flat-combining"))
+        {
+            cfg.flat_combining = 1;
+            continue;
+        }
+        if (!strcmp(arg, "--optimistic-reads"))
+        {
+            cfg.optimistic_reads = 1;
+            continue;
+        }
+        if (!strcmp(arg, "--numa"))
+        {
+            cfg.numa = 1;
+            continue;
+        }
+        if (!strcmp(arg, "--numa-local"))
+        {
+            cfg.numa = 1;
+            cfg.numa_local = 1;
+            continue;
+        }
+        if (!val)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+        if (!strcmp(arg, "--workload"))
+        {
+            if (applyWorkload(&cfg, val[0] | 0x20) != 0)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "--readprop"))
+        {
+            cfg.proportions[YCSB_READ] = atof(val);
+        }
+        else if (!strcmp(arg, "--updateprop"))
+        {
+            cfg.proportions[YCSB_UPDATE] = atof(val);
+        }
+        else if (!strcmp(arg, "--insertprop"))
+        {
+            cfg.proportions[YCSB_INSERT] = atof(val);
+        }
+        else if (!strcmp(arg, "--scanprop"))
+        {
+            cfg.proportions[YCSB_SCAN] = atof(val);
+        }
+        else if (!strcmp(arg, "--rmwprop"))
+        {
+            cfg.proportions[YCSB_RMW] = atof(val);
+        }
+        else if (!strcmp(arg, "--distribution"))
+        {
+            if (!strcmp(val, "zipfian"))
+            {
+                cfg.key_dist = DIST_ZIPFIAN;
+            }
+            else if (!strcmp(val, "latest"))
+            {
+                cfg.key_dist = DIST_LATEST;
+            }
+            else if (!strcmp(val, "uniform"))
+            {
+                cfg.key_dist = DIST_UNIFORM;
+            }
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "--engine"))
+        {
+            if (!strcmp(val, "chained"))
+            {
+                cfg.engine = ENGINE_CHAINED;
+            }
+            else if (!strcmp(val, "split"))
+            {
+                cfg.engine = ENGINE_SPLIT;
+            }
+            else if (!strcmp(val, "cuckoo"))
+            {
+                cfg.engine = ENGINE_CUCKOO;
+            }
+            else if (!strcmp(val, "robinhood"))
+            {
+                cfg.engine = ENGINE_ROBIN;
+            }
+            else if (!strcmp(val, "int"))
+            {
+                cfg.engine = ENGINE_INT;
+            }
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "--theta"))
+        {
+            cfg.theta = atof(val);
+        }
+        else if (!strcmp(arg, "--records"))
+        {
+            cfg.records = strtoul(val, NULL, 10);
+        }
+        else if (!strcmp(arg, "--ops"))
+        {
+            cfg.ops = strtoul(val, NULL, 10);
+        }
+        else if (!strcmp(arg, "--threads"))
+        {
+            cfg.threads = atoi(val);
+        }
+        else if (!strcmp(arg, "--value-size"))
+        {
+            char *dash;
+            cfg.min_value_size = strtoul(val, &dash, 10);
+            cfg.max_value_size = *dash == '-' ? strtoul(dash + 1, NULL, 10) : cfg.min_value_size;
+        }
+        else if (!strcmp(arg, "--value-dist"))
+        {
+            if (!strcmp(val, "fixed"))
+            {
+                cfg.size_dist = SIZE_FIXED;
+            }
+            else if (!strcmp(val, "uniform"))
+            {
+                cfg.size_dist = SIZE_UNIFORM;
+            }
+            else if (!strcmp(val, "zipfian"))
+            {
+                cfg.size_dist = SIZE_ZIPFIAN;
+            }
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(arg, "--max-scan"))
+        {
+            cfg.max_scan_length = strtoul(val, NULL, 10);
+        }
+        else if (!strcmp(arg, "--trace"))
+        {
+            cfg.trace_path = val;
+        }
+        else if (!strcmp(arg, "--trace-sample"))
+        {
+            cfg.trace_sample = (unsigned int)strtoul(val, NULL, 10);
+        }
+        else if (!strcmp(arg, "--near-cache"))
+        {
+            cfg.near_cache_slots = strtoul(val, NULL, 10);
+        }
+        else if (!strcmp(arg, "--shards"))
+        {
+            cfg.shards = atoi(val);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    double total = 0;
+    for (int op = 0; op < YCSB_OP_COUNT; op++)
+    {
+        total += cfg.proportions[op];
+    }
+    if (cfg.records == 0 || cfg.threads < 1 || total <= 0 || cfg.max_scan_length == 0 ||
+        cfg.min_value_size < 1 || cfg.max_value_size > MAX_VALUE_SIZE ||
+        cfg.min_value_size > cfg.max_value_size || cfg.theta <= 0 || cfg.theta >= 1 || (cfg.numa && cfg.shards < 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    for (int op = 0; op < YCSB_OP_COUNT; op++)
+    {
+        cfg.proportions[op] /= total;
+    }
+
+    CacheOptions options = {.latency_histograms = cfg.stats, .lock_profiling = cfg.stats,
+                            .near_cache_slots = cfg.near_cache_slots, .hot_key_replicas = cfg.hot_replicas,
+                            .flat_combining = cfg.flat_combining, .shard_workers = cfg.shards,
+                            .optimistic_reads = cfg.optimistic_reads, .numa_shards = cfg.numa,
+                            .numa_local_routing = cfg.numa_local};
+    Cache *cache = createCacheWithOptions(&options);
+    SplitCache *split = cfg.engine == ENGINE_SPLIT ? createSplitCache() : NULL;
+    CuckooCache *cuckoo = cfg.engine == ENGINE_CUCKOO ? createCuckooCache() : NULL;
+    RobinCache *robin = cfg.engine == ENGINE_ROBIN ? createRobinCache() : NULL;
+    IntCache *ints = cfg.engine == ENGINE_INT ? createIntCache() : NULL;
+    YcsbWorker *workers = calloc((size_t)cfg.threads, sizeof(YcsbWorker));
+    int nodes = cfg.numa ? numaNodeCount() : 1;
+    // With local routing the threads of each node load all records between them
+    int groups = cfg.numa_local ? nodes : 1;
+    size_t loaded = 0;
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        YcsbWorker *w = &workers[t];
+        w->cache = cache;
+        w->split = split;
+        w->cuckoo = cuckoo;
+        w->robin = robin;
+        w->ints = ints;
+        w->cfg = &cfg;
+        w->value = malloc(cfg.max_value_size);
+        memset(w->value, 'x', cfg.max_value_size - 1);
+        w->value[cfg.max_value_size - 1] = '\0';
+        w->node = cfg.numa ? t % nodes : -1;
+        int peers = (cfg.threads - t % groups + groups - 1) / groups;
+        int rank = t / groups;
+        size_t per_thread = cfg.records / (size_t)peers;
+        w->first = (size_t)rank * per_thread;
+        w->ops = rank == peers - 1 ? cfg.records - (size_t)rank * per_thread : per_thread;
+        loaded += w->ops;
+    }
+    double seconds = runPhase(workers, cfg.threads, loadWorker);
+    report("load", workers, cfg.threads, seconds, loaded);
+
+    insert_counter = cfg.records;
+    size_t per_thread = cfg.ops / (size_t)cfg.threads;
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        YcsbWorker *w = &workers[t];
+        memset(w->hist, 0, sizeof(w->hist));
+        w->rng = 0x9E3779B97F4A7C15ull * (uint64_t)(t + 1);
+        w->ops = t == cfg.threads - 1 ? cfg.ops - (size_t)t * per_thread : per_thread;
+        zipfianInit(&w->zipf, cfg.records, cfg.theta);
+        zipfianInit(&w->size_zipf, cfg.max_value_size - cfg.min_value_size + 1, cfg.theta);
+    }
+    if (cfg.trace_path && cfg.engine != ENGINE_CHAINED)
+    {
+        fprintf(stderr, "--trace needs --engine chained\n");
+        return 1;
+    }
+    if (cfg.trace_path && startCacheTrace(cache, cfg.trace_path, cfg.trace_sample) != 0)
+    {
+        perror(cfg.trace_path);
+        return 1;
+    }
+    seconds = runPhase(workers, cfg.threads, runWorker);
+    stopCacheTrace(cache);
+    report("run", workers, cfg.threads, seconds, cfg.ops);
+
+    if (cfg.stats)
+    {
+        CacheStats stats;
+        char info[4096];
+        if (split)
+        {
+            getSplitCacheStats(split, &stats);
+        }
+        else if (cuckoo)
+        {
+            getCuckooCacheStats(cuckoo, &stats);
+        }
+        else if (robin)
+        {
+            getRobinCacheStats(robin, &stats);
+        }
+        else if (ints)
+        {
+            getIntCacheStats(ints, &stats);
+        }
+        else
+        {
+            getCacheStats(cache, &stats);
+        }
+        formatCacheStats(&stats, info, sizeof(info));
+        printf("%s", info);
+        if (cfg.engine == ENGINE_CHAINED)
+        {
+            CacheMemory memory;
+            getCacheMemory(cache, &memory);
+            formatCacheMemory(&memory, info, sizeof(info));
+            printf("%s", info);
+        }
+    }
+
+    for (int t = 0; t < cfg.threads; t++)
+    {
+        free(workers[t].value);
+    }
+    free(workers);
+    freeCache(cache);
+    if (split)
+    {
+        freeSplitCache(split);
+    }
+    if (cuckoo)
+    {
+        freeCuckooCache(cuckoo);
+    }
+    if (robin)
+    {
+        freeRobinCache(robin);
+    }
+    if (ints)
+    {
+        freeIntCache(ints);
+    }
+    return 0;
+}
@@ -1,30 +1,28 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
-#define MAX_KEY_SIZE 256
-#define MAX_VALUE_SIZE 1024
-#define INITIAL_TABLE_SIZE 10000  
-#define LOAD_FACTOR_THRESHOLD 0.7 
+#include "lahmacuncache.h"
+#include "lahmacuncoro.h"
+#include "lahmacunprobes.h"
+#include "lahmacunsimd.h"
 
-typedef struct CacheEntry
-{
-    char key[MAX_KEY_SIZE];
-    char value[MAX_VALUE_SIZE];
-    time_t expry;
-    int is_set;
-    struct CacheEntry *next;
-} CacheEntry;
+// LAHMACUN_QUIET drops the per-operation log lines (benchmarks, tools)
+#ifdef LAHMACUN_QUIET
+#define CACHE_LOG(...) ((void)0)
+#else
+#define CACHE_LOG(...) printf(__VA_ARGS__)
+#endif
 
-typedef struct
-{
-    CacheEntry **entries; 
-    size_t table_size;
-    size_t count;        
-    pthread_mutex_t lock; 
-} Cache;
+static uint64_t next_cache_id = 1;
 
 unsigned int hash(const char *key, size_t table_size)
 {
@@ -35,151 +33,2026 @@ unsigned int hash(const char *key, size_t table_size)
         hash = ((hash << 5) + hash) + c;
     }
     return hash % table_size; 
+}
 
-// cache resize
-void resizeCache(Cache *cache)
+// Samples by key hash, so a sampled key has all of its operations recorded.
+// With tracing off this is one pointer test per operation.
+static inline void traceCache(Cache *cache, uint8_t op, const char *key, const char *value, int ttl)
 {
-    size_t new_size = cache->table_size * 2;                           
-    CacheEntry **new_entries = calloc(new_size, sizeof(CacheEntry *)); 
-    for (size_t i = 0; i < cache->table_size; i++)
+    CacheTracer *tracer = __atomic_load_n(&cache->tracer, __ATOMIC_ACQUIRE);
+    if (!tracer || !__atomic_load_n(&tracer->active, __ATOMIC_ACQUIRE))
     {
-        CacheEntry *entry = cache->entries[i];
-        while (entry)
-        {
-            unsigned int index = hash(entry->key, new_size);
-            CacheEntry *next_entry = entry->next; 
+        return;
+    }
+    size_t key_len;
+    uint64_t key_hash = traceKeyHash(key, &key_len);
+    if (key_hash % tracer->sample_rate)
+    {
+        return;
+    }
+    traceRecord(tracer, op, key_hash, key_len, value ? strlen(value) : 0, ttl);
+}
 
-            entry->next = new_entries[index]; /
-            new_entries[index] = entry;
+// Ticks at the start of an operation, 0 when latency recording is off
+static inline uint64_t latencyStart(Cache *cache)
+{
+    return cache->latency ? histTicks() : 0;
+}
 
-            entry = next_entry; 
-        }
+static inline void latencyEnd(Cache *cache, LatencyOp op, uint64_t start)
+{
+    if (cache->latency)
+    {
+        latencyRecord(cache->latency, op, histTicks() - start);
     }
-    free(cache->entries);        
-    cache->entries = new_entries; 
-    cache->table_size = new_size; 
 }
 
-Cache *createCache()
+// Lock wait is only timed when the lock is actually contended, which keeps
+// the uncontended path to two tick reads per operation
+static inline void lockCache(Cache *cache, LockSite site)
 {
-    Cache *cache = malloc(sizeof(Cache));                             
-    cache->table_size = INITIAL_TABLE_SIZE;                          
-    cache->count = 0;                                                  
-    cache->entries = calloc(INITIAL_TABLE_SIZE, sizeof(CacheEntry *)); 
-    pthread_mutex_init(&cache->lock, NULL);                          
-    return cache;
+    if (!cache->latency && !cache->lock_profile && !CACHE_PROBE_ENABLED(lock__acquire))
+    {
+        pthread_mutex_lock(&cache->lock);
+        return;
+    }
+    int contended = pthread_mutex_trylock(&cache->lock) != 0;
+    uint64_t wait = 0;
+    if (contended)
+    {
+        uint64_t start = histTicks();
+        pthread_mutex_lock(&cache->lock);
+        wait = histTicks() - start;
+    }
+    if (cache->latency)
+    {
+        latencyRecord(cache->latency, LAT_LOCK_WAIT, wait);
+    }
+    if (cache->lock_profile)
+    {
+        lockProfileAcquired(cache->lock_profile, site, contended, wait);
+    }
+    CACHE_PROBE3(lock__acquire, (int)site, contended, wait);
 }
 
-void setCache(Cache *cache, const char *key, const char *value, int ttl)
+// Lock if it is free, without waiting; counted as an uncontended acquisition
+static inline int tryLockCache(Cache *cache, LockSite site)
 {
-    pthread_mutex_lock(&cache->lock);
+    if (pthread_mutex_trylock(&cache->lock) != 0)
+    {
+        return 0;
+    }
+    if (cache->latency)
+    {
+        latencyRecord(cache->latency, LAT_LOCK_WAIT, 0);
+    }
+    if (cache->lock_profile)
+    {
+        lockProfileAcquired(cache->lock_profile, site, 0, 0);
+    }
+    CACHE_PROBE3(lock__acquire, (int)site, 0, 0);
+    return 1;
+}
 
-    if (((float)(cache->count + 1) / cache->table_size > LOAD_FACTOR_THRESHOLD))
+static inline void unlockCache(Cache *cache)
+{
+    if (cache->lock_profile)
     {
-        resizeCache(cache);
+        lockProfileReleased(cache->lock_profile);
     }
+    pthread_mutex_unlock(&cache->lock);
+}
 
-    unsigned int index = hash(key, cache->table_size); 
-    CacheEntry *entry = malloc(sizeof(CacheEntry));
-    strncpy(entry->key, key, MAX_KEY_SIZE);
-    strncpy(entry->value, value, MAX_VALUE_SIZE);
-    entry->expry = time(NULL) + ttl;
-    entry->is_set = 1;
-    entry->next = cache->entries[index];
-    cache->entries[index] = entry;       
-    cache->count++;                     
+// Only evaluated for the set probe while a tracer is attached
+static inline unsigned int chainLength(const CacheEntry *entry)
+{
+    unsigned int length = 0;
+    for (; entry; entry = entry->next)
+    {
+        length++;
+    }
+    return length;
+}
 
-    pthread_mutex_unlock(&cache->lock);
-    printf("Data added: %s -> %s (TTL: %d)\n", key, value, ttl);
+// Keys are stored cut to MAX_KEY_SIZE - 1 bytes, and looked up the same way
+static inline size_t keyLen(const char *key)
+{
+    return strnlen(key, MAX_KEY_SIZE - 1);
 }
 
-const char *getCache(Cache *cache, const char *key)
+// A key's hash before it is reduced to a bucket index: CRC32C (djb2 as in
+// hash() on CPUs without SSE4.2), or the low half of SipHash-1-3 with seed
+static inline uint32_t keyHash(const char *key, size_t key_len, int keyed, const uint64_t *seed)
 {
-    pthread_mutex_lock(&cache->lock);                 
-    unsigned int index = hash(key, cache->table_size);
-    CacheEntry *entry = cache->entries[index];        
+    if (!keyed)
+    {
+        return keyCrc32c(key, key_len);
+    }
+    return (uint32_t)sipHash13(key, key_len, seed);
+}
 
-    while (entry)
+// flags is loaded atomically since overwriteEntry rewrites it (its key bit
+// stays the same) under optimistic readers
+static inline const char *entryKey(const CacheEntry *entry)
+{
+    return __atomic_load_n(&entry->flags, __ATOMIC_RELAXED) & ENTRY_KEY_SPILLED ? entry->spilled[0] : entry->data;
+}
+
+// Inline bytes in front of the value: the key or the pointer to it
+static inline size_t keyArea(const CacheEntry *entry)
+{
+    return entry->flags & ENTRY_KEY_SPILLED ? sizeof(char *) : (size_t)entry->key_len + 1;
+}
+
+static inline const char *entryValue(const CacheEntry *entry)
+{
+    return entry->flags & ENTRY_VALUE_SPILLED ? entry->spilled[ENTRY_VALUE_POINTER] : entry->data + keyArea(entry);
+}
+
+static inline int entryMatches(const CacheEntry *entry, uint32_t key_hash, const char *key, size_t key_len)
+{
+    return entry->hash == key_hash && entry->key_len == key_len && keyEqual(entryKey(entry), key, key_len);
+}
+
+// The entry's line plus its spilled strings
+static inline int64_t entryBytes(const CacheEntry *entry)
+{
+    int64_t bytes = sizeof(CacheEntry);
+    if (entry->flags & ENTRY_KEY_SPILLED)
+    {
+        bytes += entry->key_len + 1;
+    }
+    if (entry->flags & ENTRY_VALUE_SPILLED)
+    {
+        bytes += entry->value_len + 1;
+    }
+    return bytes;
+}
+
+// With huge pages every entry comes from an arena (for a shard table, the
+// outer cache's or with NUMA shards its own), which arenaFree finds from
+// the entry's address
+static void freeEntry(Cache *cache, CacheEntry *entry)
+{
+    if (entry->flags & ENTRY_KEY_SPILLED)
+    {
+        free(entry->spilled[0]);
+    }
+    if (entry->flags & ENTRY_VALUE_SPILLED)
+    {
+        free(entry->spilled[ENTRY_VALUE_POINTER]);
+    }
+    (cache->huge_pages ? arenaFree : free)(entry);
+}
+
+// Frees memory that was reachable from the table with release: an
+// optimistic reader or a near cache hit may still be reading it, so with
+// either it waits for the epoch
+static inline void releaseWith(Cache *cache, void *ptr, void (*release)(void *ptr))
+{
+    if (cache->epoch)
+    {
+        epochRetireWith(cache->epoch, ptr, release);
+    }
+    else
+    {
+        release(ptr);
+    }
+}
+
+static inline void releaseMemory(Cache *cache, void *ptr)
+{
+    releaseWith(cache, ptr, free);
+}
+
+static void releaseEntry(Cache *cache, CacheEntry *entry)
+{
+    if (entry->flags & ENTRY_KEY_SPILLED)
+    {
+        releaseMemory(cache, entry->spilled[0]);
+    }
+    if (entry->flags & ENTRY_VALUE_SPILLED)
+    {
+        releaseMemory(cache, entry->spilled[ENTRY_VALUE_POINTER]);
+    }
+    releaseWith(cache, entry, cache->huge_pages ? arenaFree : free);
+}
+
+// The spare of an in-place update was never linked, so it and its key go
+// straight back; only the old value it took over may still be read
+static void releaseSpare(Cache *cache, CacheEntry *spare)
+{
+    if (spare->flags & ENTRY_KEY_SPILLED)
+    {
+        free(spare->spilled[0]);
+    }
+    if (spare->flags & ENTRY_VALUE_SPILLED)
+    {
+        releaseMemory(cache, spare->spilled[ENTRY_VALUE_POINTER]);
+    }
+    (cache->huge_pages ? arenaFree : free)(spare);
+}
+
+// Zeroed bucket array, from 2 MB pages with CacheOptions.huge_pages
+static CacheEntry **bucketsAlloc(Cache *cache, size_t size)
+{
+    return cache->huge_pages ? pagesAlloc(size * sizeof(CacheEntry *), NULL) : calloc(size, sizeof(CacheEntry *));
+}
+
+static void bucketsFree(Cache *cache, CacheEntry **buckets)
+{
+    (cache->huge_pages ? pagesFree : free)(buckets);
+}
+
+static inline void releaseBuckets(Cache *cache, CacheEntry **buckets)
+{
+    releaseWith(cache, buckets, cache->huge_pages ? pagesFree : free);
+}
+
+// Brackets a change of the bucket arrays or the hash; optimistic misses
+// that overlap one are retried
+static inline void tableSeqBump(Cache *cache)
+{
+    if (cache->epoch)
+    {
+        __atomic_store_n(&cache->table_seq, cache->table_seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+// Moves up to `buckets` non-empty old buckets (visiting at most ten times
+// as many empty ones) into the current table. Entries are appended so a
+// key set again after the reseed started still shadows its older copy.
+static void rehashStep(Cache *cache, size_t buckets)
+{
+    size_t empty_visits = buckets * 10;
+    while (buckets > 0 && cache->rehash_index < cache->old_size)
     {
-        if (strcmp(entry->key, key) == 0)
+        CacheEntry *entry = cache->old_entries[cache->rehash_index];
+        cache->old_entries[cache->rehash_index++] = NULL;
+        if (!entry)
         {
-            if (time(NULL) < entry->expry)
+            if (--empty_visits == 0)
             {
-                pthread_mutex_unlock(&cache->lock);
-                return entry->value;               
+                return;
             }
-            else
+            continue;
+        }
+        while (entry)
+        {
+            CacheEntry *next_entry = entry->next;
+            uint32_t key_hash = keyHash(entryKey(entry), entry->key_len, cache->keyed, cache->seed);
+            __atomic_store_n(&entry->hash, key_hash, __ATOMIC_RELAXED);
+            CacheEntry **link = &cache->entries[key_hash % cache->table_size];
+            while (*link)
             {
-                entry->is_set = 0;
-                cache->count--;    
+                link = &(*link)->next;
             }
-            entry = entry->next;
+            entry->next = NULL;
+            *link = entry;
+            entry = next_entry;
         }
+        buckets--;
+    }
+    if (cache->rehash_index == cache->old_size)
+    {
+        releaseBuckets(cache, cache->old_entries);
+        cache->old_entries = NULL;
+        cache->old_size = 0;
     }
+}
 
-    pthread_mutex_unlock(&cache->lock);
-    return NULL;                       
+// Switches to a fresh SipHash seed; the old table drains through rehashStep
+static void startReseed(Cache *cache)
+{
+    if (cache->old_entries)
+    {
+        return;
+    }
+    tableSeqBump(cache);
+    cache->old_entries = cache->entries;
+    cache->old_size = cache->table_size;
+    cache->old_keyed = cache->keyed;
+    cache->old_seed[0] = cache->seed[0];
+    cache->old_seed[1] = cache->seed[1];
+    cache->rehash_index = 0;
+    cache->entries = bucketsAlloc(cache, cache->table_size);
+    cache->keyed = 1;
+    hashRandomSeed(cache->seed);
+    tableSeqBump(cache);
+    cache->health.reseeds++;
+    CACHE_LOG("Table reseeded (window probe avg %.1f)\n",
+              cache->health.window_samples ? (double)cache->health.window_sum / cache->health.window_samples : 0.0);
 }
 
-// Deleting data
-void deleteCache(Cache *cache, const char *key)
+// Called with the lock held after every lookup/delete with the number of
+// entries it compared
+static inline void tableHealthSample(Cache *cache, unsigned int length)
 {
-    pthread_mutex_lock(&cache->lock);                  
-    unsigned int index = hash(key, cache->table_size);
-    CacheEntry *entry = cache->entries[index];        
-    CacheEntry *prev_entry = NULL;                  
+    TableHealth *h = &cache->health;
+    if (++h->ops % HEALTH_SAMPLE_INTERVAL)
+    {
+        return;
+    }
+    h->samples++;
+    h->length_sum += length;
+    if (length > h->length_max)
+    {
+        h->length_max = length;
+    }
+    h->lengths[probeHistBucket(length)]++;
+    h->window_sum += length;
+    if (++h->window_samples < HEALTH_WINDOW)
+    {
+        return;
+    }
+    if (cache->auto_reseed && !cache->old_entries && h->ops >= h->reseed_after_ops &&
+        h->window_sum > (uint64_t)HEALTH_RESEED_AVG * HEALTH_WINDOW)
+    {
+        uint64_t backoff = HEALTH_RESEED_BACKOFF << (h->reseeds < 16 ? h->reseeds : 16);
+        startReseed(cache);
+        h->reseed_after_ops = h->ops + backoff;
+    }
+    h->window_sum = 0;
+    h->window_samples = 0;
+}
 
-    while (entry)
+// Drops every thread's near cache slot for the key's stripe; called under
+// the lock before the entry it may point at is replaced or freed
+static inline void bumpKeyVersion(Cache *cache, const char *key)
+{
+    if (cache->key_versions)
     {
-        if (strcmp(entry->key, key) == 0)
-        { 
-            if (prev_entry)
-            {
-                prev_entry->next = entry->next; 
-            }
-            else
+        uint64_t *version = &cache->key_versions[nearStripe(nearHash(key))];
+        __atomic_store_n(version, *version + 1, __ATOMIC_RELEASE);
+    }
+}
+
+// Hit only while no write touched the key's stripe since the slot was
+// filled. A writer bumps the stripe before it unlinks the entry and
+// retires it through the epoch, so inside a read section an unchanged
+// stripe means the entry is still allocated; it is checked again after
+// the entry's fields are read. Returns the entry's value.
+static inline const char *nearGet(Cache *cache, const char *key, uint64_t key_hash)
+{
+    NearCache *near = nearFor(cache->id, cache->near_slots);
+    NearSlot *slot = &near->slots[key_hash & near->mask];
+    if (slot->hash != key_hash || !slot->entry)
+    {
+        return NULL;
+    }
+    unsigned int epoch_slot = statsThreadSlot();
+    if (epochEnter(cache->epoch, epoch_slot) != 0)
+    {
+        return NULL;
+    }
+    const uint64_t *version = &cache->key_versions[nearStripe(key_hash)];
+    const char *value = NULL;
+    if (__atomic_load_n(version, __ATOMIC_ACQUIRE) != slot->version)
+    {
+        slot->entry = NULL;
+    }
+    else
+    {
+        const CacheEntry *candidate = slot->entry;
+        size_t key_len = keyLen(key);
+        if (candidate->key_len == key_len && keyEqual(entryKey(candidate), key, key_len) &&
+            time(NULL) < candidate->expry)
+        {
+            const char *candidate_value = entryValue(candidate);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            value = __atomic_load_n(version, __ATOMIC_RELAXED) == slot->version ? candidate_value : NULL;
+        }
+    }
+    epochExit(cache->epoch, epoch_slot);
+    return value;
+}
+
+// Called under the lock, so the stripe version matches the entry. Not
+// only getCache fills: getCacheCopy may arrive before this thread has a
+// near cache for the table.
+static inline void nearFill(Cache *cache, const CacheEntry *entry, uint64_t key_hash)
+{
+    NearCache *near = nearFor(cache->id, cache->near_slots);
+    NearSlot *slot = &near->slots[key_hash & near->mask];
+    slot->hash = key_hash;
+    slot->entry = entry;
+    slot->version = cache->key_versions[nearStripe(key_hash)];
+}
+
+static inline unsigned int replicaCpu(void)
+{
+    int cpu = sched_getcpu();
+    return cpu >= 0 ? (unsigned int)cpu % STATS_SLOTS : statsThreadSlot();
+}
+
+static inline int copyValue(const char *value, size_t n, char *buf, size_t len);
+
+// Copies this CPU's replica of a hot key into buf like getCacheCopy. The
+// fields are checked and the value copied between two reads of seq; a
+// fill in between means a miss, and buf then holds nothing useful. -3
+// when the shared table has to answer.
+static inline int replicaGet(Cache *cache, const char *key, uint64_t key_hash, char *buf, size_t len)
+{
+    HotReplicaSet *set = __atomic_load_n(&cache->replicas[replicaCpu()], __ATOMIC_ACQUIRE);
+    if (!set)
+    {
+        return -3;
+    }
+    HotReplica *replica = &set->slots[key_hash & (HOT_REPLICA_SLOTS - 1)];
+    uint32_t seq = __atomic_load_n(&replica->seq, __ATOMIC_ACQUIRE);
+    if ((seq & 1) || replica->hash != key_hash ||
+        replica->version != __atomic_load_n(&cache->key_versions[nearStripe(key_hash)], __ATOMIC_ACQUIRE) ||
+        strncmp(replica->key, key, MAX_KEY_SIZE) != 0 || time(NULL) >= replica->expry)
+    {
+        return -3;
+    }
+    size_t value_len = __atomic_load_n(&replica->value_len, __ATOMIC_RELAXED);
+    int n = copyValue(replica->value, value_len < MAX_VALUE_SIZE ? value_len : MAX_VALUE_SIZE - 1, buf, len);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&replica->seq, __ATOMIC_RELAXED) != seq)
+    {
+        return -3;
+    }
+    __atomic_fetch_add(&replica->hits, 1, __ATOMIC_RELAXED);
+    return n;
+}
+
+// Hands the replica hits since the last window to the detector, scaled to
+// the sampling rate; under the lock, so no fill can change the replicas
+static void replicaCredit(Cache *cache)
+{
+    for (int cpu = 0; cpu < STATS_SLOTS; cpu++)
+    {
+        HotReplicaSet *set = cache->replicas[cpu];
+        for (int i = 0; set && i < HOT_REPLICA_SLOTS; i++)
+        {
+            HotReplica *replica = &set->slots[i];
+            uint64_t hits = __atomic_exchange_n(&replica->hits, 0, __ATOMIC_RELAXED);
+            if (hits >= HOT_SAMPLE_INTERVAL)
             {
-                cache->entries[index] = entry->next; 
+                hotCredit(cache->hot, replica->hash, replica->key, hits / HOT_SAMPLE_INTERVAL);
             }
-            free(entry);                       
-            cache->count--;                    
-            pthread_mutex_unlock(&cache->lock); 
-            printf("Data deleted %s\n", key);
+        }
+    }
+}
+
+// Copies a hot entry to the calling CPU's replica set unless its slot
+// already holds the key at the stripe's current version; under the lock
+static void replicaFill(Cache *cache, const CacheEntry *entry, uint64_t key_hash)
+{
+    unsigned int cpu = replicaCpu();
+    HotReplicaSet *set = cache->replicas[cpu];
+    if (set)
+    {
+        const HotReplica *replica = &set->slots[key_hash & (HOT_REPLICA_SLOTS - 1)];
+        if (replica->hash == key_hash && replica->version == cache->key_versions[nearStripe(key_hash)])
+        {
             return;
         }
-        prev_entry = entry;  
-        entry = entry->next; 
     }
-    pthread_mutex_unlock(&cache->lock); 
+    else
+    {
+        if (posix_memalign((void **)&set, CACHE_LINE_SIZE, sizeof(HotReplicaSet)) != 0)
+        {
+            return;
+        }
+        memset(set, 0, sizeof(HotReplicaSet));
+        __atomic_store_n(&cache->replicas[cpu], set, __ATOMIC_RELEASE);
+    }
+    HotReplica *replica = &set->slots[key_hash & (HOT_REPLICA_SLOTS - 1)];
+    uint32_t seq = replica->seq;
+    __atomic_store_n(&replica->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    replica->hash = key_hash;
+    replica->version = cache->key_versions[nearStripe(key_hash)];
+    replica->hits = 0;
+    replica->expry = entry->expry;
+    replica->value_len = entry->value_len;
+    memcpy(replica->key, entryKey(entry), (size_t)entry->key_len + 1);
+    memcpy(replica->value, entryValue(entry), (size_t)entry->value_len + 1);
+    __atomic_store_n(&replica->seq, seq + 2, __ATOMIC_RELEASE);
 }
 
-void freeCache(Cache *cache)
+// cache resize
+void resizeCache(Cache *cache)
 {
+    uint64_t start = cache->lock_profile ? histTicks() : 0;
+    CACHE_PROBE2(resize__start, cache->table_size, cache->count);
+    if (cache->old_entries)
+    {
+        rehashStep(cache, cache->old_size);
+    }
+    size_t new_size = cache->table_size * 2;                           
+    CacheEntry **new_entries = bucketsAlloc(cache, new_size);
+    tableSeqBump(cache);
     for (size_t i = 0; i < cache->table_size; i++)
     {
         CacheEntry *entry = cache->entries[i];
-
         while (entry)
         {
+            size_t index = entry->hash % new_size;
             CacheEntry *next_entry = entry->next; 
-            free(entry);                          
-            entry = next_entry;                  
+
+            entry->next = new_entries[index];
+            new_entries[index] = entry;
+
+            entry = next_entry; 
         }
     }
-    free(cache->entries);                
-    pthread_mutex_destroy(&cache->lock); 
-    free(cache);                       
+    releaseBuckets(cache, cache->entries);
+    cache->entries = new_entries; 
+    cache->table_size = new_size; 
+    tableSeqBump(cache);
+    CACHE_PROBE2(resize__end, cache->table_size, cache->count);
+    if (cache->lock_profile)
+    {
+        lockProfileNested(cache->lock_profile, LOCK_SITE_RESIZE, histTicks() - start);
+    }
 }
 
-int main()
+static CacheEntry *shardCall(CacheShard *shard, ShardOp op, const char *key, void *data, int64_t *expired);
+
+void reseedCache(Cache *cache)
 {
-    Cache *cache = createCache(); 
+    for (int i = 0; i < cache->shard_count; i++)
+    {
+        shardCall(&cache->shards[i], SHARD_RESEED, NULL, NULL, NULL);
+    }
+    if (cache->shards)
+    {
+        // The outer table stays empty; a reseed there would never drain
+        return;
+    }
+    lockCache(cache, LOCK_SITE_OTHER);
+    startReseed(cache);
+    unlockCache(cache);
+}
 
-    setCache(cache, "user:001", "Michael Jordan", 10);
-    setCache(cache, "user:002", "Kobe Bryant", 20);
+static void *shardWorker(void *arg);
 
-    printf("Read data: %s\n", getCache(cache, "user:001"));
-    printf("Read data: %s\n", getCache(cache, "user:002"));
+// A shard's private table. Off NUMA its entries come from the outer
+// cache's arena; on a node it keeps its own so they stay on the node.
+static Cache *shardTable(Cache *cache, int node)
+{
+    CacheOptions options = {.huge_pages = cache->huge_pages};
+    Cache *table = createCacheWithOptions(&options);
+    table->numa_node = node;
+    if (node < 0 && table->arena)
+    {
+        arenaDestroy(table->arena);
+        free(table->arena);
+        table->arena = NULL;
+    }
+    // Shard tables count into the outer cache's slots
+    free(table->stats);
+    table->stats = cache->stats;
+    return table;
+}
+
+Cache *createCache()
+{
+    return createCacheWithOptions(NULL);
+}
+
+Cache *createCacheWithOptions(const CacheOptions *options)
+{
+    Cache *cache = malloc(sizeof(Cache));                             
+    cache->table_size = INITIAL_TABLE_SIZE;                          
+    cache->count = 0;                                                  
+    cache->huge_pages = options && options->huge_pages;
+    cache->arena = NULL;
+    if (cache->huge_pages)
+    {
+        cache->arena = malloc(sizeof(PageArena));
+        arenaInit(cache->arena, sizeof(CacheEntry));
+    }
+    cache->entries = bucketsAlloc(cache, INITIAL_TABLE_SIZE);
+    pthread_mutex_init(&cache->lock, NULL);                          
+    cache->tracer = NULL;
+    cache->stats = statsCreate();
+    cache->latency = options && options->latency_histograms ? latencyCreate() : NULL;
+    cache->lock_profile = options && options->lock_profiling ? calloc(1, sizeof(LockProfile)) : NULL;
+    cache->keyed = 0;
+    cache->old_entries = NULL;
+    cache->old_size = 0;
+    cache->rehash_index = 0;
+    cache->auto_reseed = !(options && options->no_auto_reseed);
+    memset(&cache->health, 0, sizeof(cache->health));
+    cache->id = __atomic_fetch_add(&next_cache_id, 1, __ATOMIC_RELAXED);
+    cache->near_slots = 0;
+    cache->key_versions = NULL;
+    if (options && options->near_cache_slots)
+    {
+        cache->near_slots = 1;
+        while (cache->near_slots < options->near_cache_slots)
+        {
+            cache->near_slots <<= 1;
+        }
+    }
+    cache->hot = options && options->hot_key_replicas ? calloc(1, sizeof(HotKeys)) : NULL;
+    cache->hot_ops = 0;
+    memset(cache->replicas, 0, sizeof(cache->replicas));
+    cache->combine = NULL;
+    if (options && options->flat_combining &&
+        posix_memalign((void **)&cache->combine, CACHE_LINE_SIZE, STATS_SLOTS * sizeof(CombineRecord)) == 0)
+    {
+        memset(cache->combine, 0, STATS_SLOTS * sizeof(CombineRecord));
+    }
+    cache->table_seq = 0;
+    cache->optimistic = options && options->optimistic_reads;
+    cache->epoch = cache->optimistic || cache->near_slots ? epochCreate() : NULL;
+    cache->shards = NULL;
+    cache->shard_count = 0;
+    cache->numa_nodes = 0;
+    cache->numa_local = 0;
+    cache->numa_node = -1;
+    if (options && options->shard_workers > 0 &&
+        posix_memalign((void **)&cache->shards, CACHE_LINE_SIZE, options->shard_workers * sizeof(CacheShard)) == 0)
+    {
+        cache->shard_count = options->shard_workers;
+        cache->near_slots = 0;
+        free(cache->hot);
+        cache->hot = NULL;
+        free(cache->combine);
+        cache->combine = NULL;
+        cache->optimistic = 0;
+        if (cache->epoch)
+        {
+            epochFree(cache->epoch);
+            cache->epoch = NULL;
+        }
+        if (options->numa_shards)
+        {
+            cache->numa_nodes = numaNodeCount();
+            cache->numa_local = options->numa_local_routing;
+        }
+        for (int i = 0; i < cache->shard_count; i++)
+        {
+            CacheShard *shard = &cache->shards[i];
+            shardQueueInit(&shard->queue);
+            shard->owner = cache;
+            shard->node = cache->numa_nodes ? i % cache->numa_nodes : -1;
+            // A NUMA shard's worker creates its table once pinned
+            shard->table = shard->node < 0 ? shardTable(cache, -1) : NULL;
+            pthread_create(&shard->thread, NULL, shardWorker, shard);
+        }
+    }
+    if (cache->near_slots || cache->hot)
+    {
+        cache->key_versions = calloc(NEAR_VERSION_STRIPES, sizeof(uint64_t));
+    }
+    return cache;
+}
+
+static char *spill(const char *s, size_t len)
+{
+    char *copy = malloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+static CacheEntry *entryAlloc(Cache *cache)
+{
+    CacheEntry *entry = NULL;
+    if (cache->arena)
+    {
+        entry = arenaAlloc(cache->arena);
+    }
+    else if (posix_memalign((void **)&entry, CACHE_LINE_SIZE, sizeof(CacheEntry)) != 0)
+    {
+        entry = NULL;
+    }
+    return entry;
+}
+
+// Built before taking the lock, so the lock holder only links it in
+static CacheEntry *newEntry(Cache *cache, const char *key, const char *value, int ttl)
+{
+    CacheEntry *entry = entryAlloc(cache);
+    if (!entry)
+    {
+        return NULL;
+    }
+    size_t key_len = keyLen(key);
+    size_t value_len = strnlen(value, MAX_VALUE_SIZE - 1);
+    time_t expry = time(NULL) + ttl;
+    entry->expry = expry < 0 ? 0 : expry > UINT32_MAX ? UINT32_MAX : (uint32_t)expry;
+    entry->seq = 0;
+    entry->hash = 0;
+    entry->key_len = (uint8_t)key_len;
+    entry->value_len = (uint16_t)value_len;
+    entry->flags = 0;
+    if (key_len < ENTRY_INLINE_KEY_BYTES)
+    {
+        memcpy(entry->data, key, key_len);
+        entry->data[key_len] = '\0';
+    }
+    else
+    {
+        entry->flags |= ENTRY_KEY_SPILLED;
+        entry->spilled[0] = spill(key, key_len);
+    }
+    size_t area = keyArea(entry);
+    if (area + value_len < ENTRY_INLINE_BYTES)
+    {
+        memcpy(entry->data + area, value, value_len);
+        entry->data[area + value_len] = '\0';
+    }
+    else
+    {
+        entry->flags |= ENTRY_VALUE_SPILLED;
+        entry->spilled[ENTRY_VALUE_POINTER] = spill(value, value_len);
+    }
+    return entry;
+}
+
+// A copy of entry, spilled strings included, allocated and written by the
+// calling NUMA shard worker so that it lives on the worker's node; entry
+// itself is freed. Falls back to entry when out of memory.
+static CacheEntry *rehomeEntry(Cache *table, CacheEntry *entry)
+{
+    CacheEntry *local = entryAlloc(table);
+    if (!local)
+    {
+        return entry;
+    }
+    memcpy(local, entry, sizeof(CacheEntry));
+    if (entry->flags & ENTRY_KEY_SPILLED)
+    {
+        local->spilled[0] = spill(entry->spilled[0], entry->key_len);
+    }
+    if (entry->flags & ENTRY_VALUE_SPILLED)
+    {
+        local->spilled[ENTRY_VALUE_POINTER] = spill(entry->spilled[ENTRY_VALUE_POINTER], entry->value_len);
+    }
+    freeEntry(table, entry);
+    return local;
+}
+
+static CacheEntry *findChain(CacheEntry *entry, uint32_t key_hash, const char *key, size_t key_len,
+                             unsigned int *chain)
+{
+    while (entry)
+    {
+        (*chain)++;
+        if (entryMatches(entry, key_hash, key, key_len))
+        {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+// Swaps the value (inline bytes or pointer), its length and the expiry
+// between entry and spare, which have the same key and so the same key
+// area. seq is odd meanwhile, so an optimistic copy that overlaps it
+// retries; a spilled value it may have read goes through releaseEntry.
+static void overwriteEntry(CacheEntry *entry, CacheEntry *spare)
+{
+    size_t area = keyArea(entry);
+    char old_value[ENTRY_INLINE_BYTES];
+    memcpy(old_value, entry->data + area, ENTRY_INLINE_BYTES - area);
+    uint16_t old_len = entry->value_len;
+    uint8_t old_flags = entry->flags;
+    uint32_t old_expry = entry->expry;
+
+    uint32_t seq = entry->seq;
+    __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(entry->data + area, spare->data + area, ENTRY_INLINE_BYTES - area);
+    __atomic_store_n(&entry->value_len, spare->value_len, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->flags, spare->flags, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->expry, spare->expry, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+
+    memcpy(spare->data + area, old_value, ENTRY_INLINE_BYTES - area);
+    spare->value_len = old_len;
+    spare->flags = old_flags;
+    spare->expry = old_expry;
+}
+
+// Links entry in and returns NULL, or, when the key is already stored,
+// updates that entry in place and returns entry holding the old value
+// for the caller to account and free
+static CacheEntry *insertLocked(Cache *cache, const char *key, CacheEntry *entry)
+{
+    if (cache->old_entries)
+    {
+        rehashStep(cache, REHASH_STEP_BUCKETS);
+    }
+
+    const char *stored_key = entryKey(entry);
+    uint32_t key_hash = keyHash(stored_key, entry->key_len, cache->keyed, cache->seed);
+    unsigned int index = key_hash % cache->table_size;
+    unsigned int chain = 0;
+    CacheEntry *stored = findChain(cache->entries[index], key_hash, stored_key, entry->key_len, &chain);
+    if (!stored && cache->old_entries)
+    {
+        uint32_t old_hash = keyHash(stored_key, entry->key_len, cache->old_keyed, cache->old_seed);
+        stored = findChain(cache->old_entries[old_hash % cache->old_size], old_hash, stored_key, entry->key_len,
+                           &chain);
+    }
+    if (stored)
+    {
+        CACHE_PROBE3(set, strlen(key), index, chain);
+        bumpKeyVersion(cache, key);
+        overwriteEntry(stored, entry);
+        if (cache->epoch)
+        {
+            epochReclaim(cache->epoch);
+        }
+        return entry;
+    }
+
+    if (((float)(cache->count + 1) / cache->table_size > LOAD_FACTOR_THRESHOLD))
+    {
+        resizeCache(cache);
+        index = key_hash % cache->table_size;
+    }
+
+    CACHE_PROBE3(set, strlen(key), index, chainLength(cache->entries[index]));
+    entry->hash = key_hash;
+    entry->next = cache->entries[index];
+    __atomic_store_n(&cache->entries[index], entry, __ATOMIC_RELEASE);
+    cache->count++;                     
+    bumpKeyVersion(cache, key);
+    if (cache->epoch)
+    {
+        epochReclaim(cache->epoch);
+    }
+    return NULL;
+}
+
+static CacheEntry *deleteLocked(Cache *cache, const char *key);
+
+// Runs every published write, a few passes while new ones keep arriving;
+// the caller holds the lock
+static void combineLocked(Cache *cache)
+{
+    int64_t writes = 0;
+    for (int pass = 0; pass < COMBINE_PASSES; pass++)
+    {
+        int64_t found = 0;
+        for (int i = 0; i < STATS_SLOTS; i++)
+        {
+            CombineRecord *record = &cache->combine[i];
+            if (__atomic_load_n(&record->state, __ATOMIC_ACQUIRE) != COMBINE_PENDING)
+            {
+                continue;
+            }
+            if (record->op == COMBINE_SET)
+            {
+                record->entry = insertLocked(cache, record->key, record->entry);
+            }
+            else
+            {
+                record->entry = deleteLocked(cache, record->key);
+            }
+            __atomic_store_n(&record->state, COMBINE_DONE, __ATOMIC_RELEASE);
+            found++;
+        }
+        writes += found;
+        if (!found)
+        {
+            break;
+        }
+    }
+    if (writes)
+    {
+        statsAdd(cache->stats, STAT_COMBINE_BATCHES, 1);
+        statsAdd(cache->stats, STAT_COMBINED_WRITES, writes);
+    }
+}
+
+// Publishes a write and returns once a lock holder, possibly this thread,
+// has run it, with the entry it handed back. Waiting spins on the thread's own record only, then blocks
+// on the lock, which as holder runs the write itself. -1 when a thread
+// sharing the slot is using the record.
+static int combineWrite(Cache *cache, CombineOp op, const char *key, CacheEntry **entry)
+{
+    CombineRecord *record = &cache->combine[statsThreadSlot()];
+    uint32_t expected = COMBINE_EMPTY;
+    if (!__atomic_compare_exchange_n(&record->state, &expected, COMBINE_CLAIMED, 0, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED))
+    {
+        return -1;
+    }
+    record->op = op;
+    record->key = key;
+    record->entry = *entry;
+    __atomic_store_n(&record->state, COMBINE_PENDING, __ATOMIC_RELEASE);
+
+    if (tryLockCache(cache, LOCK_SITE_COMBINE))
+    {
+        combineLocked(cache);
+        unlockCache(cache);
+    }
+    for (int spins = 0; __atomic_load_n(&record->state, __ATOMIC_ACQUIRE) != COMBINE_DONE; spins++)
+    {
+        if (spins < COMBINE_SPINS)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            continue;
+        }
+        lockCache(cache, LOCK_SITE_COMBINE);
+        combineLocked(cache);
+        unlockCache(cache);
+    }
+    *entry = record->entry;
+    __atomic_store_n(&record->state, COMBINE_EMPTY, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// With local routing a key goes to one of the caller's node's shards
+// (node, node + nodes, ...); a node without shards uses them all
+static inline CacheShard *shardFor(Cache *cache, const char *key)
+{
+    uint64_t key_hash = nearHash(key);
+    if (cache->numa_local)
+    {
+        int node = numaThreadNode();
+        if (node < cache->shard_count)
+        {
+            int local = (cache->shard_count - node + cache->numa_nodes - 1) / cache->numa_nodes;
+            return &cache->shards[node + (int)(key_hash % (uint64_t)local) * cache->numa_nodes];
+        }
+    }
+    return &cache->shards[key_hash % (uint64_t)cache->shard_count];
+}
+
+// Runs one operation on the shard's worker and waits for it
+static CacheEntry *shardCall(CacheShard *shard, ShardOp op, const char *key, void *data, int64_t *expired)
+{
+    ShardRequest request = {.done = 0, .op = op, .key = key, .data = data};
+    shardPush(&shard->queue, &request);
+    shardWait(&request);
+    if (expired)
+    {
+        *expired = request.expired;
+    }
+    return request.data;
+}
+
+void setCache(Cache *cache, const char *key, const char *value, int ttl)
+{
+    uint64_t start = latencyStart(cache);
+    CacheEntry *entry = newEntry(cache, key, value, ttl);
+    if (!entry)
+    {
+        return;
+    }
+    // entry belongs to the table once linked, and may be freed by then
+    int64_t entry_bytes = entryBytes(entry);
+    int64_t key_bytes = entry->key_len + 1;
+    int64_t value_bytes = entry->value_len + 1;
+    CacheEntry *spare = entry;
+    if (cache->shards)
+    {
+        spare = shardCall(shardFor(cache, key), SHARD_SET, key, entry, NULL);
+    }
+    else if (!cache->combine || combineWrite(cache, COMBINE_SET, key, &spare) != 0)
+    {
+        lockCache(cache, LOCK_SITE_SET);
+        spare = insertLocked(cache, key, entry);
+        unlockCache(cache);
+    }
+    latencyEnd(cache, LAT_SET, start);
+    statsAdd(cache->stats, STAT_SETS, 1);
+    if (spare)
+    {
+        // Updated in place: spare was never linked and holds the old value
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, entry_bytes - entryBytes(spare));
+        statsAdd(cache->stats, STAT_VALUE_BYTES, value_bytes - (spare->value_len + 1));
+        releaseSpare(cache, spare);
+    }
+    else
+    {
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, entry_bytes);
+        statsAdd(cache->stats, STAT_KEY_BYTES, key_bytes);
+        statsAdd(cache->stats, STAT_VALUE_BYTES, value_bytes);
+    }
+    traceCache(cache, TRACE_SET, key, value, ttl);
+    CACHE_LOG("Data added: %s -> %s (TTL: %d)\n", key, value, ttl);
+}
+
+// Walks one chain for a live entry, unlinking expired copies of the key
+static CacheEntry *getChain(Cache *cache, CacheEntry **bucket, unsigned int index, uint32_t key_hash,
+                            const char *key, size_t key_len, int64_t *expired, unsigned int *chain)
+{
+    CacheEntry *entry = *bucket;
+    CacheEntry *prev_entry = NULL;
+
+    while (entry)
+    {
+        (*chain)++;
+        if (entryMatches(entry, key_hash, key, key_len))
+        {
+            if (time(NULL) < entry->expry)
+            {
+                return entry;
+            }
+            else
+            {
+                // Expired: unlink and free it here rather than leaving it in the chain
+                CacheEntry *next_entry = entry->next;
+                __atomic_store_n(prev_entry ? &prev_entry->next : bucket, next_entry, __ATOMIC_RELEASE);
+                CACHE_PROBE3(expire, strlen(key), index, *chain);
+                bumpKeyVersion(cache, key);
+                statsAdd(cache->stats, STAT_ENTRY_BYTES, -entryBytes(entry));
+                statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)entry->key_len - 1);
+                statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)entry->value_len - 1);
+                releaseEntry(cache, entry);
+                cache->count--;    
+                (*expired)++;
+                if (cache->epoch)
+                {
+                    epochReclaim(cache->epoch);
+                }
+                entry = next_entry;
+                continue;
+            }
+        }
+        prev_entry = entry;
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+// Bookkeeping at the end of a locked lookup: probe length, hot key sample,
+// USDT probe and the near cache and replica fills of a hit
+// replicate: the caller is getCacheCopy, the only reader of hot replicas,
+// so a hot key's replica is filled or refreshed
+static CacheEntry *getDone(Cache *cache, const char *key, uint64_t key_hash, CacheEntry *entry,
+                           unsigned int index, unsigned int chain, int replicate)
+{
+    tableHealthSample(cache, chain);
+    if (cache->hot && ++cache->hot_ops % HOT_SAMPLE_INTERVAL == 0)
+    {
+        if (cache->hot->window_samples + 1 >= HOT_WINDOW)
+        {
+            replicaCredit(cache);
+        }
+        hotSample(cache->hot, key_hash, key);
+    }
+
+    if (!entry)
+    {
+        CACHE_PROBE3(get__miss, strlen(key), index, chain);
+        return NULL;
+    }
+    CACHE_PROBE3(get__hit, strlen(key), index, chain);
+    if (cache->near_slots)
+    {
+        nearFill(cache, entry, key_hash);
+    }
+    if (replicate && cache->hot && hotIsHot(cache->hot, key_hash))
+    {
+        replicaFill(cache, entry, key_hash);
+    }
+    return entry;
+}
+
+// Lookup in both tables with the lock held (or on the shard's worker)
+static CacheEntry *getLocked(Cache *cache, const char *key, uint64_t key_hash, int64_t *expired, int replicate)
+{
+    if (cache->old_entries)
+    {
+        rehashStep(cache, REHASH_STEP_BUCKETS);
+    }
+    size_t key_len = keyLen(key);
+    uint32_t hash = keyHash(key, key_len, cache->keyed, cache->seed);
+    unsigned int index = hash % cache->table_size;
+    unsigned int chain = 0;
+    CacheEntry *entry = getChain(cache, &cache->entries[index], index, hash, key, key_len, expired, &chain);
+    if (!entry && cache->old_entries)
+    {
+        uint32_t old_hash = keyHash(key, key_len, cache->old_keyed, cache->old_seed);
+        unsigned int old_index = old_hash % cache->old_size;
+        entry = getChain(cache, &cache->old_entries[old_index], old_index, old_hash, key, key_len, expired, &chain);
+    }
+    return getDone(cache, key, key_hash, entry, index, chain, replicate);
+}
+
+const char *getCache(Cache *cache, const char *key)
+{
+    uint64_t start = latencyStart(cache);
+    uint64_t key_hash = cache->key_versions ? nearHash(key) : 0;
+    if (cache->near_slots)
+    {
+        const char *value = nearGet(cache, key, key_hash);
+        if (value)
+        {
+            latencyEnd(cache, LAT_GET, start);
+            statsAdd(cache->stats, STAT_GETS, 1);
+            statsAdd(cache->stats, STAT_HITS, 1);
+            statsAdd(cache->stats, STAT_NEAR_HITS, 1);
+            traceCache(cache, TRACE_GET | TRACE_HIT, key, value, 0);
+            return value;
+        }
+    }
+    // The value pointer is taken while the entry is still owned: finding
+    // it reads the entry's flags, which a writer may free right after
+    const char *value = NULL;
+    int64_t expired = 0;
+    if (cache->shards)
+    {
+        value = (const char *)shardCall(shardFor(cache, key), SHARD_GET, key, NULL, &expired);
+    }
+    else
+    {
+        lockCache(cache, LOCK_SITE_GET);
+        CacheEntry *entry = getLocked(cache, key, key_hash, &expired, 0);
+        value = entry ? entryValue(entry) : NULL;
+        unlockCache(cache);
+    }
+    latencyEnd(cache, LAT_GET, start);
+    statsAdd(cache->stats, STAT_GETS, 1);
+    if (expired)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, expired);
+    }
+    if (value)
+    {
+        statsAdd(cache->stats, STAT_HITS, 1);
+        traceCache(cache, TRACE_GET | TRACE_HIT, key, value, 0);
+        return value;
+    }
+    statsAdd(cache->stats, STAT_MISSES, 1);
+    traceCache(cache, TRACE_GET, key, NULL, 0);
+    return NULL;                       
+}
+
+// Copies value (n bytes) into buf like snprintf and returns n
+static inline int copyValue(const char *value, size_t n, char *buf, size_t len)
+{
+    if (len)
+    {
+        size_t copy = n < len ? n : len - 1;
+        memcpy(buf, value, copy);
+        buf[copy] = '\0';
+    }
+    return (int)n;
+}
+
+// One lock-free lookup inside the caller's epoch read section: the value
+// length on a hit, -1 on a miss, -2 when it raced a writer and -3 when
+// only the lock can answer (reseed running, entry expired, chain too long)
+static int optimisticGet(Cache *cache, const char *key, char *buf, size_t len)
+{
+    uint32_t table_seq = __atomic_load_n(&cache->table_seq, __ATOMIC_ACQUIRE);
+    CacheEntry **entries = __atomic_load_n(&cache->entries, __ATOMIC_RELAXED);
+    size_t table_size = __atomic_load_n(&cache->table_size, __ATOMIC_RELAXED);
+    int keyed = __atomic_load_n(&cache->keyed, __ATOMIC_RELAXED);
+    uint64_t seed[2] = {__atomic_load_n(&cache->seed[0], __ATOMIC_RELAXED),
+                        __atomic_load_n(&cache->seed[1], __ATOMIC_RELAXED)};
+    int rehashing = __atomic_load_n(&cache->old_entries, __ATOMIC_RELAXED) != NULL;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ((table_seq & 1) || __atomic_load_n(&cache->table_seq, __ATOMIC_RELAXED) != table_seq)
+    {
+        return -2;
+    }
+    if (rehashing)
+    {
+        return -3;
+    }
+
+    // A linked entry's key never changes; its hash only when a reseed
+    // moves it, and then table_seq has moved too
+    size_t key_len = keyLen(key);
+    uint32_t key_hash = keyHash(key, key_len, keyed, seed);
+    CacheEntry *entry = __atomic_load_n(&entries[key_hash % table_size], __ATOMIC_ACQUIRE);
+    for (unsigned int chain = 0;
+         entry && (__atomic_load_n(&entry->hash, __ATOMIC_RELAXED) != key_hash || entry->key_len != key_len ||
+                   !keyEqual(entryKey(entry), key, key_len));
+         chain++)
+    {
+        if (chain == OPTIMISTIC_MAX_CHAIN)
+        {
+            return -3;
+        }
+        entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+    }
+    if (!entry)
+    {
+        // A resize moving the chain under us can hide the key
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&cache->table_seq, __ATOMIC_RELAXED) == table_seq ? -1 : -2;
+    }
+
+    uint32_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+    {
+        return -2;
+    }
+    uint32_t expry = __atomic_load_n(&entry->expry, __ATOMIC_RELAXED);
+    uint8_t flags = __atomic_load_n(&entry->flags, __ATOMIC_RELAXED);
+    size_t n = __atomic_load_n(&entry->value_len, __ATOMIC_RELAXED);
+    size_t area = flags & ENTRY_KEY_SPILLED ? sizeof(char *) : key_len + 1;
+    if (flags & ENTRY_VALUE_SPILLED)
+    {
+        // The pointer is checked before it is followed; a spilled value is
+        // never written after it is built and the epoch keeps it allocated
+        const char *value = __atomic_load_n(&entry->spilled[ENTRY_VALUE_POINTER], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq)
+        {
+            return -2;
+        }
+        copyValue(value, n, buf, len);
+    }
+    else
+    {
+        if (area + n >= ENTRY_INLINE_BYTES)
+        {
+            return -2;
+        }
+        copyValue(entry->data + area, n, buf, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq)
+        {
+            return -2;
+        }
+    }
+    return time(NULL) < expry ? (int)n : -3;
+}
+
+// Copies the value for key into buf (truncated, always terminated when len
+// is not 0) and returns its full length, or -1 when the key is not cached.
+// Unlike the pointer getCache returns, the copy stays valid whatever
+// writers do next. Hot keys are copied from this CPU's replica; with
+// CacheOptions.optimistic_reads the lookup usually takes no lock. The
+// near cache is not consulted.
+int getCacheCopy(Cache *cache, const char *key, char *buf, size_t len)
+{
+    uint64_t start = latencyStart(cache);
+    int n = cache->hot ? replicaGet(cache, key, nearHash(key), buf, len) : -3;
+    int64_t expired = 0;
+    if (n >= 0)
+    {
+        statsAdd(cache->stats, STAT_REPLICA_HITS, 1);
+    }
+    else if (cache->optimistic)
+    {
+        unsigned int slot = statsThreadSlot();
+        if (epochEnter(cache->epoch, slot) == 0)
+        {
+            n = optimisticGet(cache, key, buf, len);
+            for (int retry = 0; n == -2 && retry < OPTIMISTIC_RETRIES; retry++)
+            {
+                statsAdd(cache->stats, STAT_OPTIMISTIC_RETRIES, 1);
+                n = optimisticGet(cache, key, buf, len);
+            }
+            epochExit(cache->epoch, slot);
+        }
+        if (n < -1)
+        {
+            statsAdd(cache->stats, STAT_OPTIMISTIC_FALLBACKS, 1);
+        }
+    }
+    if (n < -1)
+    {
+        if (cache->shards)
+        {
+            ShardRequest request = {.done = 0, .op = SHARD_COPY, .key = key, .buf = buf, .len = len};
+            CacheShard *shard = shardFor(cache, key);
+            shardPush(&shard->queue, &request);
+            shardWait(&request);
+            expired = request.expired;
+            n = request.data ? (int)request.len : -1;
+        }
+        else
+        {
+            lockCache(cache, LOCK_SITE_GET);
+            CacheEntry *entry = getLocked(cache, key, cache->key_versions ? nearHash(key) : 0, &expired, 1);
+            n = entry ? copyValue(entryValue(entry), entry->value_len, buf, len) : -1;
+            unlockCache(cache);
+        }
+    }
+    latencyEnd(cache, LAT_GET, start);
+    statsAdd(cache->stats, STAT_GETS, 1);
+    statsAdd(cache->stats, n >= 0 ? STAT_HITS : STAT_MISSES, 1);
+    if (expired)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, expired);
+    }
+    traceCache(cache, n >= 0 ? TRACE_GET | TRACE_HIT : TRACE_GET, key, n >= 0 && len ? buf : NULL, 0);
+    return n;
+}
+
+// One get as a coroutine, run with the lock held and touching only what
+// its previous step prefetched. It ends with entry set to the live entry
+// or NULL, or with result -2 when it met an expired copy of the key:
+// getLocked unlinks that one, once no other walk can be pointing at it.
+static int lookupResume(Cache *cache, CacheLookup *lookup, time_t now)
+{
+    CORO_BEGIN(lookup->line);
+    lookup->result = -1;
+    lookup->key_len = keyLen(lookup->key);
+    lookup->hash = keyHash(lookup->key, lookup->key_len, cache->keyed, cache->seed);
+    lookup->index = lookup->hash % cache->table_size;
+    lookup->chain = 0;
+    __builtin_prefetch(&cache->entries[lookup->index]);
+    CORO_YIELD(lookup->line);
+
+    for (lookup->entry = cache->entries[lookup->index]; lookup->entry; lookup->entry = lookup->entry->next)
+    {
+        __builtin_prefetch(lookup->entry);
+        CORO_YIELD(lookup->line);
+        lookup->chain++;
+        if (entryMatches(lookup->entry, lookup->hash, lookup->key, lookup->key_len))
+        {
+            break;
+        }
+    }
+    if (lookup->entry && now >= lookup->entry->expry)
+    {
+        lookup->result = -2;
+    }
+    else if (lookup->entry && lookup->entry->flags & ENTRY_VALUE_SPILLED)
+    {
+        __builtin_prefetch(entryValue(lookup->entry));
+        CORO_YIELD(lookup->line);
+    }
+    CORO_END(lookup->line);
+}
+
+static inline int lookupCopy(CacheLookup *lookup, CacheEntry *entry)
+{
+    return entry ? copyValue(entryValue(entry), entry->value_len, lookup->buf, lookup->len) : -1;
+}
+
+// lookups[0..n) with the lock held. Lookups the coroutines cannot settle
+// keep result -2 and go through getLocked once none is in flight, since
+// it may free or move entries other walks point at: a key with an expired
+// copy, and every lookup not finished when a reseed (possibly started by a
+// lookup's health sample) begins moving entries between tables.
+static size_t lookupsLocked(Cache *cache, CacheLookup *lookups, size_t n, int64_t *expired)
+{
+    CacheLookup *running[BATCH_INFLIGHT];
+    size_t next = 0;
+    size_t hits = 0;
+    int active = 0;
+    time_t now = time(NULL);
+    for (size_t i = 0; i < n; i++)
+    {
+        lookups[i].line = 0;
+        lookups[i].result = -2;
+    }
+    while (!cache->old_entries && active < BATCH_INFLIGHT && next < n)
+    {
+        running[active++] = &lookups[next++];
+    }
+    while (active && !cache->old_entries)
+    {
+        for (int i = 0; i < active && !cache->old_entries;)
+        {
+            CacheLookup *lookup = running[i];
+            if (!lookupResume(cache, lookup, now))
+            {
+                i++;
+                continue;
+            }
+            if (lookup->result != -2)
+            {
+                uint64_t key_hash = cache->key_versions ? nearHash(lookup->key) : 0;
+                CacheEntry *entry =
+                    getDone(cache, lookup->key, key_hash, lookup->entry, lookup->index, lookup->chain, 0);
+                lookup->result = lookupCopy(lookup, entry);
+                hits += entry != NULL;
+            }
+            if (next < n)
+            {
+                running[i++] = &lookups[next++];
+            }
+            else
+            {
+                running[i] = running[--active];
+            }
+        }
+    }
+    for (int i = 0; i < active; i++)
+    {
+        running[i]->result = -2;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (lookups[i].result == -2)
+        {
+            const char *key = lookups[i].key;
+            CacheEntry *entry = getLocked(cache, key, cache->key_versions ? nearHash(key) : 0, expired, 0);
+            lookups[i].result = lookupCopy(&lookups[i], entry);
+            hits += entry != NULL;
+        }
+    }
+    return hits;
+}
+
+// Runs n gets, each copying its value out like getCacheCopy, and returns
+// the number of hits. Every lookup's result is set, and its done callback
+// called, by the time this returns; callbacks run without the lock held
+// and may use the cache. Shard workers own their tables, so with shards
+// each key is sent to its worker as usual. Latency histograms do not see
+// these gets.
+size_t runCacheLookups(Cache *cache, CacheLookup *lookups, size_t n)
+{
+    size_t hits = 0;
+    int64_t expired = 0;
+    for (size_t first = 0; first < n; first += BATCH_LOCK_KEYS)
+    {
+        size_t count = n - first > BATCH_LOCK_KEYS ? BATCH_LOCK_KEYS : n - first;
+        CacheLookup *chunk = lookups + first;
+        if (cache->shards)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                chunk[i].result = getCacheCopy(cache, chunk[i].key, chunk[i].buf, chunk[i].len);
+                hits += chunk[i].result >= 0;
+            }
+        }
+        else
+        {
+            lockCache(cache, LOCK_SITE_GET);
+            hits += lookupsLocked(cache, chunk, count, &expired);
+            unlockCache(cache);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            if (chunk[i].done)
+            {
+                chunk[i].done(&chunk[i], chunk[i].arg);
+            }
+        }
+    }
+    if (cache->shards)
+    {
+        return hits;
+    }
+    statsAdd(cache->stats, STAT_GETS, (int64_t)n);
+    statsAdd(cache->stats, STAT_HITS, (int64_t)hits);
+    statsAdd(cache->stats, STAT_MISSES, (int64_t)(n - hits));
+    if (expired)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, expired);
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        const CacheLookup *lookup = &lookups[i];
+        traceCache(cache, lookup->result >= 0 ? TRACE_GET | TRACE_HIT : TRACE_GET, lookup->key,
+                   lookup->result >= 0 && lookup->len ? lookup->buf : NULL, 0);
+    }
+    return hits;
+}
+
+// Copies out n values like n getCacheCopy calls: key i's value goes to
+// bufs + i * len and results[i] is its length, or -1 on a miss. Returns
+// the number of hits.
+size_t getCacheBatch(Cache *cache, const char *const *keys, size_t n, char *bufs, size_t len, int *results)
+{
+    CacheLookup lookups[BATCH_LOCK_KEYS];
+    size_t hits = 0;
+    for (size_t first = 0; first < n; first += BATCH_LOCK_KEYS)
+    {
+        size_t count = n - first > BATCH_LOCK_KEYS ? BATCH_LOCK_KEYS : n - first;
+        for (size_t i = 0; i < count; i++)
+        {
+            lookups[i] = (CacheLookup){.key = keys[first + i], .buf = len ? bufs + (first + i) * len : NULL, .len = len};
+        }
+        hits += runCacheLookups(cache, lookups, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            results[first + i] = lookups[i].result;
+        }
+    }
+    return hits;
+}
+
+// Unlinks the first entry for key from one chain
+static CacheEntry *unlinkChain(CacheEntry **bucket, uint32_t key_hash, const char *key, size_t key_len,
+                               unsigned int *chain)
+{
+    CacheEntry *entry = *bucket;
+    CacheEntry *prev_entry = NULL;                  
+
+    while (entry)
+    {
+        (*chain)++;
+        if (entryMatches(entry, key_hash, key, key_len))
+        { 
+            __atomic_store_n(prev_entry ? &prev_entry->next : bucket, entry->next, __ATOMIC_RELEASE);
+            return entry;
+        }
+        prev_entry = entry;  
+        entry = entry->next; 
+    }
+    return NULL;
+}
+
+// Unlinks the newest entry for key; the caller frees it after unlocking
+static CacheEntry *deleteLocked(Cache *cache, const char *key)
+{
+    if (cache->old_entries)
+    {
+        rehashStep(cache, REHASH_STEP_BUCKETS);
+    }
+    size_t key_len = keyLen(key);
+    uint32_t hash = keyHash(key, key_len, cache->keyed, cache->seed);
+    unsigned int index = hash % cache->table_size;
+    unsigned int chain = 0;
+    CacheEntry *entry = unlinkChain(&cache->entries[index], hash, key, key_len, &chain);
+    if (!entry && cache->old_entries)
+    {
+        uint32_t old_hash = keyHash(key, key_len, cache->old_keyed, cache->old_seed);
+        entry = unlinkChain(&cache->old_entries[old_hash % cache->old_size], old_hash, key, key_len, &chain);
+    }
+    tableHealthSample(cache, chain);
+
+    if (entry)
+    {
+        CACHE_PROBE3(delete, strlen(key), index, chain);
+        bumpKeyVersion(cache, key);
+        cache->count--;                    
+        if (cache->epoch)
+        {
+            epochReclaim(cache->epoch);
+        }
+        return entry;
+    }
+    CACHE_PROBE3(delete, strlen(key), index, 0);
+    return NULL;
+}
+
+// Deleting data
+void deleteCache(Cache *cache, const char *key)
+{
+    uint64_t start = latencyStart(cache);
+    CacheEntry *entry = NULL;
+    if (cache->shards)
+    {
+        entry = shardCall(shardFor(cache, key), SHARD_DELETE, key, NULL, NULL);
+    }
+    else if (!cache->combine || combineWrite(cache, COMBINE_DELETE, key, &entry) != 0)
+    {
+        lockCache(cache, LOCK_SITE_DELETE);
+        entry = deleteLocked(cache, key);
+        unlockCache(cache); 
+    }
+    latencyEnd(cache, LAT_DELETE, start);
+    statsAdd(cache->stats, STAT_DELETES, 1);
+    if (entry)
+    {
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -entryBytes(entry));
+        statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)entry->key_len - 1);
+        statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)entry->value_len - 1);
+        releaseEntry(cache, entry);
+        traceCache(cache, TRACE_DELETE | TRACE_HIT, key, NULL, 0);
+        CACHE_LOG("Data deleted %s\n", key);
+        return;
+    }
+    traceCache(cache, TRACE_DELETE, key, NULL, 0);
+}
+
+void freeCache(Cache *cache)
+{
+    for (int i = 0; i < cache->shard_count; i++)
+    {
+        CacheShard *shard = &cache->shards[i];
+        shardCall(shard, SHARD_STOP, NULL, NULL, NULL);
+        pthread_join(shard->thread, NULL);
+        shard->table->stats = NULL;
+        freeCache(shard->table);
+    }
+    free(cache->shards);
+    for (size_t i = 0; i < cache->table_size; i++)
+    {
+        CacheEntry *entry = cache->entries[i];
+
+        while (entry)
+        {
+            CacheEntry *next_entry = entry->next; 
+            freeEntry(cache, entry);
+            entry = next_entry;                  
+        }
+    }
+    bucketsFree(cache, cache->entries);
+    if (cache->old_entries)
+    {
+        for (size_t i = cache->rehash_index; i < cache->old_size; i++)
+        {
+            CacheEntry *entry = cache->old_entries[i];
+            while (entry)
+            {
+                CacheEntry *next_entry = entry->next;
+                freeEntry(cache, entry);
+                entry = next_entry;
+            }
+        }
+        bucketsFree(cache, cache->old_entries);
+    }
+    if (cache->tracer)
+    {
+        traceClose(cache->tracer);
+        pthread_mutex_destroy(&cache->tracer->lock);
+        free(cache->tracer);
+    }
+    free(cache->stats);
+    if (cache->latency)
+    {
+        latencyFree(cache->latency);
+    }
+    free(cache->lock_profile);
+    free(cache->key_versions);
+    free(cache->hot);
+    free(cache->combine);
+    if (cache->epoch)
+    {
+        epochFree(cache->epoch);
+    }
+    // After the epoch, which may still hold retired entries
+    if (cache->arena)
+    {
+        arenaDestroy(cache->arena);
+        free(cache->arena);
+    }
+    for (int cpu = 0; cpu < STATS_SLOTS; cpu++)
+    {
+        free(cache->replicas[cpu]);
+    }
+    pthread_mutex_destroy(&cache->lock); 
+    free(cache);                       
+}
+
+// Adds one table's shape to stats; called by its lock holder or shard worker
+static void tableStats(Cache *cache, CacheStats *stats)
+{
+    const TableHealth *h = &cache->health;
+    stats->count += cache->count;
+    stats->table_size += cache->table_size;
+    stats->bucket_bytes += (cache->table_size + cache->old_size) * sizeof(CacheEntry *);
+    stats->keyed_hash |= cache->keyed;
+    stats->rehashing |= cache->old_entries != NULL;
+    stats->health.ops += h->ops;
+    stats->health.samples += h->samples;
+    stats->health.length_sum += h->length_sum;
+    if (h->length_max > stats->health.length_max)
+    {
+        stats->health.length_max = h->length_max;
+    }
+    for (int i = 0; i < PROBE_HIST_BUCKETS; i++)
+    {
+        stats->health.lengths[i] += h->lengths[i];
+    }
+    stats->health.reseeds += h->reseeds;
+}
+
+// Sums the per-thread counters; the table shape is read under the lock,
+// or from each shard's worker
+void getCacheStats(Cache *cache, CacheStats *stats)
+{
+    LockProfile profile;
+    statsAggregate(cache->stats, stats);
+    stats->count = 0;
+    stats->table_size = 0;
+    stats->bucket_bytes = 0;
+    stats->keyed_hash = 0;
+    stats->rehashing = 0;
+    memset(&stats->health, 0, sizeof(stats->health));
+    for (int i = 0; i < cache->shard_count; i++)
+    {
+        shardCall(&cache->shards[i], SHARD_STATS, NULL, stats, NULL);
+    }
+    lockCache(cache, LOCK_SITE_OTHER);
+    if (!cache->shards)
+    {
+        tableStats(cache, stats);
+    }
+    stats->hash_function = !stats->keyed_hash && simdCrcActive() ? "crc32c" : NULL;
+    stats->has_hot_keys = cache->hot != NULL;
+    if (cache->hot)
+    {
+        stats->hot_samples = cache->hot->samples;
+        stats->hot_promotions = cache->hot->promotions;
+        stats->hot_key_count = cache->hot->hot_keys;
+        memcpy(stats->hot_keys, cache->hot->hot_key, sizeof(stats->hot_keys));
+        memcpy(stats->hot_counts, cache->hot->hot_count, sizeof(stats->hot_counts));
+    }
+    if (cache->lock_profile)
+    {
+        profile = *cache->lock_profile;
+    }
+    unlockCache(cache);
+    stats->has_latency = cache->latency != NULL;
+    if (cache->latency)
+    {
+        latencySummarize(cache->latency, stats->latency);
+    }
+    stats->has_lock_profile = cache->lock_profile != NULL;
+    if (cache->lock_profile)
+    {
+        lockProfileSummarize(&profile, stats->lock_sites);
+    }
+}
+
+// Usable size of a live block plus the allocator's size header
+static size_t allocatorChunk(void *block, size_t size)
+{
+#ifdef __GLIBC__
+    return block ? malloc_usable_size(block) + sizeof(size_t) : size;
+#else
+    (void)block;
+    return (size + sizeof(size_t) + 15) & ~(size_t)15;
+#endif
+}
+
+static uint64_t residentBytes(void)
+{
+    unsigned long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file)
+    {
+        return 0;
+    }
+    if (fscanf(file, "%lu %lu", &pages, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(file);
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+// AnonHugePages of /proc/self/smaps_rollup, in bytes
+static uint64_t anonHugeBytes(void)
+{
+    unsigned long kb = 0;
+    char line[128];
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    if (!file)
+    {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+        {
+            break;
+        }
+    }
+    fclose(file);
+    return (uint64_t)kb * 1024;
+}
+
+// A bucket array's footprint: its malloc chunk, or its whole mapping
+static size_t bucketsChunk(Cache *cache, CacheEntry **buckets, size_t size, CacheMemory *memory)
+{
+    if (!cache->huge_pages)
+    {
+        return allocatorChunk(buckets, size * sizeof(CacheEntry *));
+    }
+    if (pagesKind(buckets) != PAGES_SMALL)
+    {
+        memory->huge_page_bytes += pagesMapped(buckets);
+    }
+    return pagesMapped(buckets);
+}
+
+static void arenaMemory(PageArena *arena, CacheMemory *memory)
+{
+    size_t huge;
+    memory->arena_bytes += arenaMapped(arena, &huge);
+    memory->huge_page_bytes += huge;
+}
+
+// Adds one table's allocations to memory. Shard tables' bucket arrays are
+// summed into one class entry; entries all come from one size class.
+static void tableMemory(Cache *cache, CacheMemory *memory)
+{
+    MemorySizeClass *buckets = &memory->classes[MEMORY_CLASS_BUCKETS];
+    buckets->size += cache->table_size * sizeof(CacheEntry *);
+    buckets->chunk += bucketsChunk(cache, cache->entries, cache->table_size, memory);
+    buckets->count = 1;
+    if (cache->old_entries)
+    {
+        MemorySizeClass *old = &memory->classes[MEMORY_CLASS_OLD_BUCKETS];
+        old->size += cache->old_size * sizeof(CacheEntry *);
+        old->chunk += bucketsChunk(cache, cache->old_entries, cache->old_size, memory);
+        old->count = 1;
+    }
+    CacheEntry *sample = NULL;
+    for (size_t i = 0; i < cache->table_size && !sample; i++)
+    {
+        sample = cache->entries[i];
+    }
+    MemorySizeClass *entries = &memory->classes[MEMORY_CLASS_ENTRY];
+    entries->size = sizeof(CacheEntry);
+    if (cache->huge_pages)
+    {
+        entries->chunk = sizeof(CacheEntry); // slab slots carry no header
+    }
+    else if (sample || !entries->chunk)
+    {
+        entries->chunk = allocatorChunk(sample, sizeof(CacheEntry));
+    }
+    entries->count += cache->count;
+    if (cache->arena)
+    {
+        arenaMemory(cache->arena, memory);
+    }
+}
+
+// Byte breakdown from the counters plus the table shape; cheap enough to
+// poll, nothing is walked
+void getCacheMemory(Cache *cache, CacheMemory *memory)
+{
+    CacheStats stats;
+    memset(memory, 0, sizeof(*memory));
+    statsAggregate(cache->stats, &stats);
+
+    for (int i = 0; i < cache->shard_count; i++)
+    {
+        shardCall(&cache->shards[i], SHARD_MEMORY, NULL, memory, NULL);
+    }
+    if (!cache->shards)
+    {
+        lockCache(cache, LOCK_SITE_OTHER);
+        tableMemory(cache, memory);
+        unlockCache(cache);
+    }
+    else if (cache->arena)
+    {
+        arenaMemory(cache->arena, memory);
+    }
+    const MemorySizeClass *buckets = &memory->classes[MEMORY_CLASS_BUCKETS];
+    uint64_t count = memory->classes[MEMORY_CLASS_ENTRY].count;
+
+    memory->bucket_bytes = buckets->size + memory->classes[MEMORY_CLASS_OLD_BUCKETS].size;
+    // Keys are stored exactly; the inline area's slack is charged to values
+    uint64_t spilled_bytes = stats.entry_bytes - count * sizeof(CacheEntry);
+    memory->entry_header_bytes = count * offsetof(CacheEntry, data);
+    memory->key_bytes = stats.key_bytes;
+    memory->key_reserved_bytes = stats.key_bytes;
+    memory->value_bytes = stats.value_bytes;
+    memory->value_reserved_bytes = count * ENTRY_INLINE_BYTES + spilled_bytes - stats.key_bytes;
+
+    uint64_t allocated = 0;
+    for (int c = 0; c < MEMORY_CLASS_COUNT; c++)
+    {
+        const MemorySizeClass *sc = &memory->classes[c];
+        memory->allocator_overhead_bytes += (sc->chunk - sc->size) * sc->count;
+        allocated += sc->chunk * sc->count;
+    }
+    allocated += spilled_bytes;
+    if (memory->arena_bytes)
+    {
+        allocated += memory->arena_bytes - count * sizeof(CacheEntry); // free slots and chunk headers
+    }
+    memory->anon_huge_bytes = anonHugeBytes();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    memory->allocator_free_bytes = mallinfo2().fordblks;
+#endif
+    memory->rss_bytes = residentBytes();
+
+    uint64_t needed = memory->bucket_bytes + memory->entry_header_bytes + memory->key_bytes + memory->value_bytes;
+    memory->fragmentation_ratio = needed ? (double)allocated / (double)needed : 0.0;
+}
+
+// Owns shard->table: runs queued operations in arrival order until SHARD_STOP
+static void *shardWorker(void *arg)
+{
+    CacheShard *shard = arg;
+    if (shard->node >= 0)
+    {
+        // Requests queued meanwhile wait in the queue until the table exists
+        numaPinThread(shard->node);
+        shard->table = shardTable(shard->owner, shard->node);
+    }
+    Cache *table = shard->table;
+    for (;;)
+    {
+        ShardRequest *request = shardNext(&shard->queue);
+        switch (request->op)
+        {
+        case SHARD_GET:
+            request->data = getLocked(table, request->key, 0, &request->expired, 0);
+            request->data = request->data ? (void *)entryValue(request->data) : NULL;
+            break;
+        case SHARD_COPY:
+            request->data = getLocked(table, request->key, 0, &request->expired, 0);
+            if (request->data)
+            {
+                const CacheEntry *entry = request->data;
+                request->len = (size_t)copyValue(entryValue(entry), entry->value_len, request->buf, request->len);
+            }
+            break;
+        case SHARD_SET:
+            if (table->numa_node >= 0)
+            {
+                request->data = rehomeEntry(table, request->data);
+            }
+            request->data = insertLocked(table, request->key, request->data);
+            break;
+        case SHARD_DELETE:
+            request->data = deleteLocked(table, request->key);
+            break;
+        case SHARD_RESEED:
+            startReseed(table);
+            break;
+        case SHARD_STATS:
+            tableStats(table, request->data);
+            break;
+        case SHARD_MEMORY:
+            tableMemory(table, request->data);
+            break;
+        case SHARD_STOP:
+            shardComplete(request);
+            return NULL;
+        }
+        shardComplete(request);
+    }
+}
+
+// Writes <prefix>.<op>.hgrm for every operation type, values in microseconds
+int exportCacheLatency(Cache *cache, const char *prefix)
+{
+    if (!cache->latency)
+    {
+        return -1;
+    }
+    Histogram *merged = malloc(sizeof(Histogram));
+    double ticks_per_us = histTicksPerNs() * 1000.0;
+    int rc = 0;
+    for (int op = 0; op < LAT_COUNT && rc == 0; op++)
+    {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s.%s.hgrm", prefix, latency_op_names[op]);
+        FILE *file = fopen(path, "w");
+        if (!file)
+        {
+            rc = -1;
+            break;
+        }
+        latencyMerge(cache->latency, (LatencyOp)op, merged);
+        histExport(merged, file, ticks_per_us);
+        fclose(file);
+    }
+    free(merged);
+    return rc;
+}
+
+// Starts writing a trace of 1 in sample_rate keys to path. The tracer is
+// never freed before freeCache, so operations racing with stopCacheTrace
+// only ever see an inactive tracer.
+int startCacheTrace(Cache *cache, const char *path, unsigned int sample_rate)
+{
+    lockCache(cache, LOCK_SITE_OTHER);
+    CacheTracer *tracer = cache->tracer;
+    if (!tracer)
+    {
+        tracer = calloc(1, sizeof(CacheTracer));
+        pthread_mutex_init(&tracer->lock, NULL);
+    }
+    pthread_mutex_lock(&tracer->lock);
+    int rc = tracer->active ? -1 : traceOpen(tracer, path, sample_rate);
+    pthread_mutex_unlock(&tracer->lock);
+    __atomic_store_n(&cache->tracer, tracer, __ATOMIC_RELEASE);
+    unlockCache(cache);
+    return rc;
+}
+
+void stopCacheTrace(Cache *cache)
+{
+    CacheTracer *tracer = __atomic_load_n(&cache->tracer, __ATOMIC_ACQUIRE);
+    if (tracer)
+    {
+        traceClose(tracer);
+    }
+}
+
+#ifndef LAHMACUN_NO_MAIN
+int main()
+{
+    CacheOptions options = {.latency_histograms = 1, .lock_profiling = 1};
+    Cache *cache = createCacheWithOptions(&options);
+
+    setCache(cache, "user:001", "Michael Jordan", 10);
+    setCache(cache, "user:002", "Kobe Bryant", 20);
+
+    printf("Read data: %s\n", getCache(cache, "user:001"));
+    printf("Read data: %s\n", getCache(cache, "user:002"));
+
+    CacheStats stats;
+    char info[4096];
+    getCacheStats(cache, &stats);
+    formatCacheStats(&stats, info, sizeof(info));
+    printf("%s", info);
+
+    CacheMemory memory;
+    getCacheMemory(cache, &memory);
+    formatCacheMemory(&memory, info, sizeof(info));
+    printf("%s", info);
 
     // deleteCache(cache, "user:001");
     // printf("Read data: %s\n", getCache(cache, "user:1002")); // NULL (deleted)
@@ -187,3 +2060,4 @@ int main()
     freeCache(cache);
     return 0;
 }
+#endif
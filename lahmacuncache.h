@@ -0,0 +1,262 @@
+#ifndef LAHMACUNCACHE_H
+#define LAHMACUNCACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacunepoch.h"
+#include "lahmacunhash.h"
+#include "lahmacunhot.h"
+#include "lahmacunnear.h"
+#include "lahmacunnuma.h"
+#include "lahmacunpages.h"
+#include "lahmacunshard.h"
+#include "lahmacunstats.h"
+#include "lahmacuntrace.h"
+
+#define MAX_KEY_SIZE 256
+#define MAX_VALUE_SIZE 1024
+#define INITIAL_TABLE_SIZE 10000
+#define LOAD_FACTOR_THRESHOLD 0.7
+
+// Table health: one in HEALTH_SAMPLE_INTERVAL lookups/deletes has its probe
+// length sampled. A window of HEALTH_WINDOW samples averaging more than
+// HEALTH_RESEED_AVG (a healthy table at this load factor averages ~1-2)
+// moves the table to a freshly seeded SipHash, REHASH_STEP_BUCKETS per
+// operation. Repeated reseeds back off, since long chains of duplicate
+// keys do not get shorter with any hash.
+#define HEALTH_SAMPLE_INTERVAL 64
+#define HEALTH_WINDOW 128
+#define HEALTH_RESEED_AVG 16
+#define HEALTH_RESEED_BACKOFF 65536
+#define REHASH_STEP_BUCKETS 4
+
+// An entry is one cache line: a 24-byte header and ENTRY_INLINE_BYTES for
+// the key and value. A key is stored there when it fits in
+// ENTRY_INLINE_KEY_BYTES, and the value after it when it fits in what is
+// left; otherwise that string goes to its own buffer and the inline area
+// holds a pointer to it (the key's at the start, the value's in the last
+// 8 bytes). Short items are then read from the entry's line alone. Keys
+// and values longer than MAX_KEY_SIZE - 1 / MAX_VALUE_SIZE - 1 are cut.
+#define ENTRY_INLINE_BYTES 40
+#define ENTRY_INLINE_KEY_BYTES 32 // terminator included; leaves room for a value pointer
+#define ENTRY_KEY_SPILLED 0x1
+#define ENTRY_VALUE_SPILLED 0x2
+#define ENTRY_VALUE_POINTER (ENTRY_INLINE_BYTES / sizeof(char *) - 1)
+
+typedef struct CacheEntry
+{
+    struct CacheEntry *next;
+    uint32_t expry; // seconds since the Unix epoch
+    uint32_t seq;   // odd while a set rewrites the value in place
+    uint32_t hash;  // of the table the entry is linked in: its index is hash % table_size
+    uint16_t value_len;
+    uint8_t key_len;
+    uint8_t flags; // ENTRY_*_SPILLED
+    union
+    {
+        char data[ENTRY_INLINE_BYTES];
+        char *spilled[ENTRY_INLINE_BYTES / sizeof(char *)]; // [0]: key, [ENTRY_VALUE_POINTER]: value
+    };
+} __attribute__((aligned(CACHE_LINE_SIZE))) CacheEntry;
+
+// Flat combining: a writer publishes its set/delete in its thread slot's
+// record and whoever holds Cache.lock runs every published write in one
+// batch, so under write contention the lock and the table heads stay in
+// one core's cache instead of moving with every write
+#define COMBINE_SPINS 128
+#define COMBINE_PASSES 4
+
+typedef enum
+{
+    COMBINE_EMPTY,
+    COMBINE_CLAIMED, // being filled in by its writer
+    COMBINE_PENDING,
+    COMBINE_DONE
+} CombineState;
+
+typedef enum
+{
+    COMBINE_SET,
+    COMBINE_DELETE
+} CombineOp;
+
+typedef struct
+{
+    uint32_t state;
+    uint32_t op;
+    const char *key;
+    CacheEntry *entry; // set: the entry to link; delete: the unlinked entry, or NULL
+} __attribute__((aligned(CACHE_LINE_SIZE))) CombineRecord;
+
+// Hot keys: one in HOT_SAMPLE_INTERVAL gets that reach the shared table
+// feeds the detector (lahmacunhot.h). A hit on a hot key copies it into
+// the reading CPU's HotReplicaSet; later getCacheCopy calls on that CPU
+// copy the value out of the replica while the key's version stripe is
+// unchanged. getCache never returns replica memory, which the next fill
+// of the slot rewrites.
+#define HOT_SAMPLE_INTERVAL 16
+#define HOT_REPLICA_SLOTS 16
+
+// Only written under Cache.lock, so there is a single writer; seq is odd
+// while a fill is in progress and readers that see it change fall back
+// to the shared table
+typedef struct
+{
+    uint32_t seq;
+    uint64_t hash;
+    uint64_t version;
+    uint64_t hits; // reads served since the detector last collected them
+    time_t expry;
+    uint32_t value_len;
+    char key[MAX_KEY_SIZE];
+    char value[MAX_VALUE_SIZE];
+} HotReplica;
+
+typedef struct
+{
+    HotReplica slots[HOT_REPLICA_SLOTS];
+} __attribute__((aligned(CACHE_LINE_SIZE))) HotReplicaSet;
+
+typedef struct
+{
+    int latency_histograms; // record per-operation latency (see lahmacunhist.h)
+    int lock_profiling;     // count acquisitions, contention, wait and hold time of Cache.lock per call site
+    int no_auto_reseed;     // keep djb2 even when probe lengths look flooded
+    size_t near_cache_slots; // per-thread L1 slots, rounded up to a power of two; 0 = off
+    int hot_key_replicas;   // detect hot keys and serve their reads from per-CPU copies
+    int flat_combining;     // batch concurrent sets and deletes under one lock acquisition
+    int shard_workers;      // split the table between this many owner threads; 0 = off (see CacheShard)
+    int optimistic_reads;   // getCacheCopy walks the table without the lock (see OPTIMISTIC_RETRIES)
+    int huge_pages;         // bucket arrays and entries on 2 MB pages (see lahmacunpages.h)
+    int numa_shards;        // with shard_workers: place shards round robin on NUMA nodes (see CacheShard)
+    int numa_local_routing; // with numa_shards: route each thread's keys to its own node's shards
+} CacheOptions;
+
+// Optimistic copy-out: getCacheCopy finds the entry without the lock,
+// inside an epoch read section (lahmacunepoch.h) so nothing it walks is
+// freed under it, and copies the value between two reads of the entry's
+// seq. A miss is checked against Cache.table_seq, which resizes and
+// reseeds bump. A read that keeps racing writers, finds an expired entry
+// or arrives during a reseed takes the lock.
+#define OPTIMISTIC_RETRIES 4
+#define OPTIMISTIC_MAX_CHAIN 64
+
+// Interleaved lookups: a CacheLookup is one get written as a coroutine
+// (lahmacuncoro.h) that prefetches the bucket, entry or value it needs
+// next and then suspends. runCacheLookups resumes up to BATCH_INFLIGHT of
+// them round robin, under one lock hold per BATCH_LOCK_KEYS lookups, so
+// the cache misses of different keys overlap instead of being waited out
+// one after the other (asynchronous memory access chaining). getCacheBatch
+// runs on it; a server loop can queue the gets of all its ready
+// connections and answer each from its done callback, which is called
+// once the lock is released.
+#define BATCH_INFLIGHT 8
+#define BATCH_LOCK_KEYS 64
+
+typedef struct CacheLookup
+{
+    const char *key;
+    char *buf; // the value is copied here like getCacheCopy does
+    size_t len;
+    void (*done)(struct CacheLookup *lookup, void *arg); // optional
+    void *arg;
+    int result; // value length, -1 on a miss
+    // coroutine state
+    int line;
+    size_t key_len;
+    uint32_t hash;
+    unsigned int index;
+    unsigned int chain;
+    CacheEntry *entry;
+} CacheLookup;
+
+struct Cache;
+
+// Delegation: with CacheOptions.shard_workers each shard's table is a
+// private Cache that only its worker thread ever touches, so it is never
+// locked and its buckets stay in that core's cache. Keys are routed by
+// nearHash; a caller posts its operation on the shard's queue and waits.
+// The near cache, hot key replicas and flat combining are off in this
+// mode; statistics, latency and tracing stay on the outer Cache.
+//
+// With CacheOptions.numa_shards shard i belongs to NUMA node i % nodes
+// (lahmacunnuma.h). Its worker pins itself to that node's CPUs and only
+// then creates its table, so buckets, entries (copied over from the
+// caller's allocation on every set) and its own huge page arena are
+// first touched, and so placed, on the node. numa_local_routing hashes a
+// key over the shards of the calling thread's node only: a server that
+// pins each worker with numaPinThread and hands it the connections
+// accepted on its node never crosses the interconnect, but each node is
+// then a keyspace of its own and sees only the keys written from it.
+typedef struct
+{
+    ShardQueue queue;
+    struct Cache *table;
+    pthread_t thread;
+    int node; // -1 unless CacheOptions.numa_shards
+    struct Cache *owner; // the outer cache
+} CacheShard;
+
+typedef struct Cache
+{
+    CacheEntry **entries;
+    size_t table_size;
+    size_t count;
+    int keyed; // 0: djb2, 1: SipHash-1-3 with seed
+    uint64_t seed[2];
+    CacheEntry **old_entries; // table being drained by an incremental reseed, else NULL
+    size_t old_size;
+    size_t rehash_index; // old buckets below this are already moved
+    int old_keyed;
+    uint64_t old_seed[2];
+    int auto_reseed;
+    TableHealth health;
+    uint64_t id; // distinguishes caches to the thread-local near caches
+    size_t near_slots; // 0 unless CacheOptions.near_cache_slots
+    uint64_t *key_versions; // NEAR_VERSION_STRIPES write counters, with the near cache or hot replicas
+    HotKeys *hot; // NULL unless CacheOptions.hot_key_replicas
+    uint64_t hot_ops;
+    HotReplicaSet *replicas[STATS_SLOTS]; // per CPU, allocated on first fill
+    CombineRecord *combine; // STATS_SLOTS records, NULL unless CacheOptions.flat_combining
+    CacheShard *shards; // NULL unless CacheOptions.shard_workers; the table above then stays empty
+    int shard_count;
+    int numa_nodes; // shards are spread over this many nodes; 0 unless CacheOptions.numa_shards
+    int numa_local; // CacheOptions.numa_local_routing
+    int numa_node; // a shard table's node with CacheOptions.numa_shards, else -1
+    uint32_t table_seq; // odd while entries/table_size/seed are being swapped
+    EpochDomain *epoch; // NULL unless CacheOptions.optimistic_reads or near_cache_slots
+    int optimistic; // CacheOptions.optimistic_reads: getCacheCopy tries the lock-free walk
+    pthread_mutex_t lock;
+    CacheTracer *tracer; // NULL until the first startCacheTrace
+    CacheStatsSlot *stats;
+    LatencyRecorder *latency; // NULL unless CacheOptions.latency_histograms
+    LockProfile *lock_profile; // NULL unless CacheOptions.lock_profiling
+    int huge_pages; // bucket arrays from pagesAlloc, entries from an arena
+    PageArena *arena; // entry slab, NULL unless CacheOptions.huge_pages (shard tables use the outer one, NUMA shards their own)
+} Cache;
+
+unsigned int hash(const char *key, size_t table_size);
+void resizeCache(Cache *cache);
+void reseedCache(Cache *cache);
+Cache *createCache();
+Cache *createCacheWithOptions(const CacheOptions *options);
+void setCache(Cache *cache, const char *key, const char *value, int ttl);
+// The returned pointer is into the table: it stays valid only until the
+// key is next set, deleted or expired, since a set rewrites the entry in
+// place and frees a replaced spilled value. Readers that race writers or
+// keep the value use getCacheCopy.
+const char *getCache(Cache *cache, const char *key);
+int getCacheCopy(Cache *cache, const char *key, char *buf, size_t len);
+size_t getCacheBatch(Cache *cache, const char *const *keys, size_t n, char *bufs, size_t len, int *results);
+size_t runCacheLookups(Cache *cache, CacheLookup *lookups, size_t n);
+void deleteCache(Cache *cache, const char *key);
+void freeCache(Cache *cache);
+void getCacheStats(Cache *cache, CacheStats *stats);
+void getCacheMemory(Cache *cache, CacheMemory *memory);
+int exportCacheLatency(Cache *cache, const char *prefix);
+int startCacheTrace(Cache *cache, const char *path, unsigned int sample_rate);
+void stopCacheTrace(Cache *cache);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef LAHMACUNCORO_H
+#define LAHMACUNCORO_H
+
+// Stackless coroutines in plain C (the switch trick of Duff's device and
+// protothreads). A coroutine is a function returning int whose state,
+// including an int resume point that starts at 0, lives in a struct its
+// caller keeps. CORO_YIELD saves the resume point and returns 0; calling
+// the function again continues after the yield. CORO_END returns 1, and
+// keeps returning 1 if the coroutine is resumed again.
+//
+// Locals do not survive a yield, so anything used across one belongs in
+// the state struct. A yield may sit inside loops and ifs but not inside a
+// switch of the coroutine's own, and at most one yield fits on a line.
+//
+//   int walk(Walk *w)
+//   {
+//       CORO_BEGIN(w->line);
+//       for (w->node = w->head; w->node; w->node = w->node->next)
+//       {
+//           __builtin_prefetch(w->node);
+//           CORO_YIELD(w->line);
+//           ...
+//       }
+//       CORO_END(w->line);
+//   }
+
+#define CORO_BEGIN(line) \
+    switch (line)        \
+    {                    \
+    case 0:
+
+#define CORO_YIELD(line)    \
+    do                      \
+    {                       \
+        (line) = __LINE__;  \
+        return 0;           \
+    case __LINE__:;         \
+    } while (0)
+
+#define CORO_END(line) \
+    }                  \
+    (line) = -1;       \
+    return 1
+
+#endif
@@ -0,0 +1,484 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lahmacuncuckoo.h"
+#include "lahmacunhash.h"
+
+#define CUCKOO_RECLAIM_INTERVAL 64
+
+typedef struct
+{
+    size_t bucket;
+    uint16_t path; // slot choices so far, two bits each, first choice highest
+    uint8_t depth;
+    uint8_t root;  // 0: first candidate bucket, 1: second
+} CuckooBfsNode;
+
+static inline uint8_t tagOf(uint64_t hash)
+{
+    uint8_t tag = (uint8_t)(hash >> 56);
+    return tag ? tag : 1;
+}
+
+// Its own inverse: the other bucket of whatever sits in bucket with tag
+static inline size_t altIndex(size_t bucket, uint8_t tag, size_t mask)
+{
+    return (bucket ^ ((size_t)tag * 0xc6a4a7935bd1e995ull)) & mask;
+}
+
+static inline uint32_t *versionOf(CuckooCache *cache, uint64_t hash)
+{
+    return &cache->versions[(hash >> 32) & (CUCKOO_VERSION_STRIPES - 1)];
+}
+
+// Writer only: odd from here until versionEnd
+static inline void versionBegin(uint32_t *version)
+{
+    __atomic_store_n(version, *version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void versionEnd(uint32_t *version)
+{
+    __atomic_store_n(version, *version + 1, __ATOMIC_RELEASE);
+}
+
+static inline const char *itemValue(const CuckooItem *item)
+{
+    return item->data + item->key_len + 1;
+}
+
+static inline int64_t itemBytes(const CuckooItem *item)
+{
+    return (int64_t)(sizeof(CuckooItem) + item->key_len + item->value_len + 2);
+}
+
+static CuckooTable *tableCreate(size_t buckets)
+{
+    CuckooTable *table = malloc(sizeof(CuckooTable));
+    table->mask = buckets - 1;
+    if (posix_memalign((void **)&table->buckets, CACHE_LINE_SIZE, buckets * sizeof(CuckooBucket)) != 0)
+    {
+        free(table);
+        return NULL;
+    }
+    memset(table->buckets, 0, buckets * sizeof(CuckooBucket));
+    return table;
+}
+
+static inline int itemMatches(const CuckooItem *item, uint64_t hash, const char *key, size_t key_len)
+{
+    return item && item->hash == hash && item->key_len == key_len && memcmp(item->data, key, key_len) == 0;
+}
+
+// Writer side: the slot holding key, or NULL
+static CuckooBucket *findSlot(CuckooTable *table, uint64_t hash, const char *key, size_t key_len, int *slot)
+{
+    uint8_t tag = tagOf(hash);
+    size_t index = hash & table->mask;
+    for (int way = 0; way < 2; way++)
+    {
+        CuckooBucket *bucket = &table->buckets[index];
+        for (int s = 0; s < CUCKOO_SLOTS; s++)
+        {
+            if (bucket->tags[s] == tag && itemMatches(bucket->items[s], hash, key, key_len))
+            {
+                *slot = s;
+                return bucket;
+            }
+        }
+        index = altIndex(index, tag, table->mask);
+    }
+    return NULL;
+}
+
+static inline int freeSlot(const CuckooBucket *bucket)
+{
+    for (int s = 0; s < CUCKOO_SLOTS; s++)
+    {
+        if (!bucket->tags[s])
+        {
+            return s;
+        }
+    }
+    return -1;
+}
+
+// Item first, tag second: a reader that matches the tag finds the item.
+// Both are release stores so the item's contents are visible to a reader
+// that loads either.
+static inline void slotFill(CuckooBucket *bucket, int slot, uint8_t tag, CuckooItem *item)
+{
+    __atomic_store_n(&bucket->items[slot], item, __ATOMIC_RELEASE);
+    __atomic_store_n(&bucket->tags[slot], tag, __ATOMIC_RELEASE);
+}
+
+static inline void slotClear(CuckooBucket *bucket, int slot)
+{
+    __atomic_store_n(&bucket->tags[slot], 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&bucket->items[slot], NULL, __ATOMIC_RELAXED);
+}
+
+// Breadth-first search for the shortest chain of displacements that ends
+// in a bucket with a free slot. Fills the buckets and slots to move from
+// (the last bucket is the one with room) and returns the number of moves,
+// or -1 when none is found within CUCKOO_BFS_NODES buckets.
+static int findPath(CuckooTable *table, size_t first, size_t second, size_t *buckets, int *slots)
+{
+    CuckooBfsNode queue[CUCKOO_BFS_NODES];
+    int head = 0, tail = 0;
+    queue[tail++] = (CuckooBfsNode){first, 0, 0, 0};
+    queue[tail++] = (CuckooBfsNode){second, 0, 0, 1};
+    while (head < tail)
+    {
+        CuckooBfsNode node = queue[head++];
+        const CuckooBucket *bucket = &table->buckets[node.bucket];
+        for (int s = 0; s < CUCKOO_SLOTS; s++)
+        {
+            size_t alt = altIndex(node.bucket, bucket->tags[s], table->mask);
+            uint16_t path = (uint16_t)(node.path << 2 | s);
+            int depth = node.depth + 1;
+            if (freeSlot(&table->buckets[alt]) >= 0)
+            {
+                size_t index = node.root ? second : first;
+                for (int d = 0; d < depth; d++)
+                {
+                    buckets[d] = index;
+                    slots[d] = path >> (2 * (depth - 1 - d)) & 3;
+                    index = altIndex(index, table->buckets[index].tags[slots[d]], table->mask);
+                }
+                buckets[depth] = index;
+                return depth;
+            }
+            if (depth < CUCKOO_MAX_DEPTH && tail < CUCKOO_BFS_NODES)
+            {
+                queue[tail++] = (CuckooBfsNode){alt, path, (uint8_t)depth, node.root};
+            }
+        }
+    }
+    return -1;
+}
+
+// Places a new item, displacing others along a cuckoo path if both its
+// buckets are full. -1 when the table needs to grow.
+static int tableInsert(CuckooCache *cache, CuckooTable *table, CuckooItem *item)
+{
+    uint8_t tag = tagOf(item->hash);
+    size_t first = item->hash & table->mask;
+    size_t second = altIndex(first, tag, table->mask);
+    int slot = freeSlot(&table->buckets[first]);
+    if (slot >= 0)
+    {
+        slotFill(&table->buckets[first], slot, tag, item);
+        return 0;
+    }
+    slot = freeSlot(&table->buckets[second]);
+    if (slot >= 0)
+    {
+        slotFill(&table->buckets[second], slot, tag, item);
+        return 0;
+    }
+
+    size_t buckets[CUCKOO_MAX_DEPTH + 1];
+    int slots[CUCKOO_MAX_DEPTH + 1];
+    int depth = findPath(table, first, second, buckets, slots);
+    if (depth < 0)
+    {
+        return -1;
+    }
+    // Move from the free end back towards the new item's bucket. An item
+    // is written to its other bucket before it leaves this one, under its
+    // version, so readers never miss it without noticing.
+    int hole = freeSlot(&table->buckets[buckets[depth]]);
+    for (int d = depth - 1; d >= 0; d--)
+    {
+        CuckooBucket *from = &table->buckets[buckets[d]];
+        CuckooBucket *to = &table->buckets[buckets[d + 1]];
+        if (to->tags[hole] || !from->tags[slots[d]])
+        {
+            return -1; // the path crossed itself
+        }
+        CuckooItem *moved = from->items[slots[d]];
+        uint32_t *version = versionOf(cache, moved->hash);
+        versionBegin(version);
+        slotFill(to, hole, from->tags[slots[d]], moved);
+        slotClear(from, slots[d]);
+        versionEnd(version);
+        hole = slots[d];
+    }
+    slotFill(&table->buckets[buckets[0]], hole, tag, item);
+    return 0;
+}
+
+// Doubles the table under the writer lock. Items are shared with the old
+// table, which readers may still be walking until the epoch moves on.
+static void cuckooGrow(CuckooCache *cache)
+{
+    CuckooTable *old = cache->table;
+    size_t buckets = (old->mask + 1) * 2;
+    for (;;)
+    {
+        CuckooTable *table = tableCreate(buckets);
+        int full = 0;
+        for (size_t i = 0; i <= old->mask && !full; i++)
+        {
+            for (int s = 0; s < CUCKOO_SLOTS && !full; s++)
+            {
+                if (old->buckets[i].tags[s])
+                {
+                    full = tableInsert(cache, table, old->buckets[i].items[s]) != 0;
+                }
+            }
+        }
+        if (!full)
+        {
+            __atomic_store_n(&cache->table, table, __ATOMIC_RELEASE);
+            break;
+        }
+        free(table->buckets);
+        free(table);
+        buckets *= 2;
+    }
+    epochRetire(cache->epoch, old->buckets);
+    epochRetire(cache->epoch, old);
+}
+
+// Frees expired items in the new key's two buckets so their slots can be
+// reused instead of displacing live ones
+static int64_t dropExpired(CuckooCache *cache, CuckooTable *table, uint64_t hash, int64_t *bytes)
+{
+    time_t now = time(NULL);
+    int64_t dropped = 0;
+    size_t index = hash & table->mask;
+    for (int way = 0; way < 2; way++)
+    {
+        CuckooBucket *bucket = &table->buckets[index];
+        for (int s = 0; s < CUCKOO_SLOTS; s++)
+        {
+            CuckooItem *item = bucket->items[s];
+            if (bucket->tags[s] && now >= item->expry)
+            {
+                uint32_t *version = versionOf(cache, item->hash);
+                versionBegin(version);
+                slotClear(bucket, s);
+                versionEnd(version);
+                statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)item->key_len - 1);
+                statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)item->value_len - 1);
+                *bytes += itemBytes(item);
+                epochRetire(cache->epoch, item);
+                cache->count--;
+                dropped++;
+            }
+        }
+        index = altIndex(index, tagOf(hash), table->mask);
+    }
+    return dropped;
+}
+
+static inline void cuckooReclaim(CuckooCache *cache)
+{
+    if (cache->epoch->retired && ++cache->writes % CUCKOO_RECLAIM_INTERVAL == 0)
+    {
+        epochReclaim(cache->epoch);
+    }
+}
+
+CuckooCache *createCuckooCache(void)
+{
+    CuckooCache *cache;
+    if (posix_memalign((void **)&cache, CACHE_LINE_SIZE, sizeof(CuckooCache)) != 0)
+    {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(CuckooCache));
+    cache->table = tableCreate(CUCKOO_INITIAL_BUCKETS);
+    hashRandomSeed(cache->seed);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->epoch = epochCreate();
+    cache->stats = statsCreate();
+    return cache;
+}
+
+void setCuckooCache(CuckooCache *cache, const char *key, const char *value, int ttl)
+{
+    size_t key_len = strlen(key), value_len = strlen(value);
+    CuckooItem *item = malloc(sizeof(CuckooItem) + key_len + value_len + 2);
+    item->hash = sipHash13(key, key_len, cache->seed);
+    item->expry = time(NULL) + ttl;
+    item->key_len = (uint32_t)key_len;
+    item->value_len = (uint32_t)value_len;
+    memcpy(item->data, key, key_len + 1);
+    memcpy(item->data + key_len + 1, value, value_len + 1);
+
+    // item may be replaced and freed as soon as the lock is dropped
+    int64_t new_bytes = itemBytes(item);
+    int64_t old_bytes = 0, old_value_len = -1, expired_bytes = 0, expired = 0;
+    pthread_mutex_lock(&cache->lock);
+    int slot;
+    CuckooBucket *bucket = findSlot(cache->table, item->hash, key, key_len, &slot);
+    if (bucket)
+    {
+        CuckooItem *old = bucket->items[slot];
+        uint32_t *version = versionOf(cache, item->hash);
+        versionBegin(version);
+        __atomic_store_n(&bucket->items[slot], item, __ATOMIC_RELEASE);
+        versionEnd(version);
+        old_bytes = itemBytes(old);
+        old_value_len = old->value_len;
+        epochRetire(cache->epoch, old);
+    }
+    else
+    {
+        expired = dropExpired(cache, cache->table, item->hash, &expired_bytes);
+        while (tableInsert(cache, cache->table, item) != 0)
+        {
+            cuckooGrow(cache);
+        }
+        cache->count++;
+    }
+    cuckooReclaim(cache);
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_SETS, 1);
+    statsAdd(cache->stats, STAT_ENTRY_BYTES, new_bytes - old_bytes - expired_bytes);
+    statsAdd(cache->stats, STAT_KEY_BYTES, bucket ? 0 : (int64_t)key_len + 1);
+    statsAdd(cache->stats, STAT_VALUE_BYTES, (int64_t)value_len - old_value_len);
+    if (expired)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, expired);
+    }
+}
+
+// One lookup: the value length on a hit, -1 on a miss, -2 when a writer
+// touched the key's stripe meanwhile
+static int cuckooRead(CuckooCache *cache, uint64_t hash, const char *key, size_t key_len, char *buf, size_t len)
+{
+    uint32_t *version = versionOf(cache, hash);
+    uint32_t before = __atomic_load_n(version, __ATOMIC_ACQUIRE);
+    if (before & 1)
+    {
+        return -2;
+    }
+    // Loaded after the version, so a write that finished before it is
+    // never looked for in a table it already replaced
+    CuckooTable *table = __atomic_load_n(&cache->table, __ATOMIC_ACQUIRE);
+    uint8_t tag = tagOf(hash);
+    size_t index = hash & table->mask;
+    const CuckooItem *found = NULL;
+    for (int way = 0; way < 2 && !found; way++)
+    {
+        CuckooBucket *bucket = &table->buckets[index];
+        for (int s = 0; s < CUCKOO_SLOTS && !found; s++)
+        {
+            if (__atomic_load_n(&bucket->tags[s], __ATOMIC_ACQUIRE) == tag)
+            {
+                const CuckooItem *item = __atomic_load_n(&bucket->items[s], __ATOMIC_ACQUIRE);
+                found = itemMatches(item, hash, key, key_len) ? item : NULL;
+            }
+        }
+        index = altIndex(index, tag, table->mask);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(version, __ATOMIC_RELAXED) != before)
+    {
+        return -2;
+    }
+    if (!found || time(NULL) >= found->expry)
+    {
+        return -1;
+    }
+    if (len)
+    {
+        size_t copy = found->value_len < len ? found->value_len : len - 1;
+        memcpy(buf, itemValue(found), copy);
+        buf[copy] = '\0';
+    }
+    return (int)found->value_len;
+}
+
+// Copies the value like getCacheCopy: full length, or -1 when absent.
+// Expired items read as misses and are freed by a later set.
+int getCuckooCache(CuckooCache *cache, const char *key, char *buf, size_t len)
+{
+    size_t key_len = strlen(key);
+    uint64_t hash = sipHash13(key, key_len, cache->seed);
+    unsigned int slot = epochEnterSlot(cache->epoch);
+    int n = cuckooRead(cache, hash, key, key_len, buf, len);
+    for (int retry = 0; n == -2 && retry < CUCKOO_READ_RETRIES; retry++)
+    {
+        statsAdd(cache->stats, STAT_OPTIMISTIC_RETRIES, 1);
+        n = cuckooRead(cache, hash, key, key_len, buf, len);
+    }
+    if (n == -2)
+    {
+        statsAdd(cache->stats, STAT_OPTIMISTIC_FALLBACKS, 1);
+        pthread_mutex_lock(&cache->lock);
+        n = cuckooRead(cache, hash, key, key_len, buf, len);
+        pthread_mutex_unlock(&cache->lock);
+    }
+    epochExit(cache->epoch, slot);
+    statsAdd(cache->stats, STAT_GETS, 1);
+    statsAdd(cache->stats, n >= 0 ? STAT_HITS : STAT_MISSES, 1);
+    return n;
+}
+
+void deleteCuckooCache(CuckooCache *cache, const char *key)
+{
+    size_t key_len = strlen(key);
+    uint64_t hash = sipHash13(key, key_len, cache->seed);
+    CuckooItem *item = NULL;
+    pthread_mutex_lock(&cache->lock);
+    int slot;
+    CuckooBucket *bucket = findSlot(cache->table, hash, key, key_len, &slot);
+    if (bucket)
+    {
+        item = bucket->items[slot];
+        uint32_t *version = versionOf(cache, hash);
+        versionBegin(version);
+        slotClear(bucket, slot);
+        versionEnd(version);
+        cache->count--;
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -itemBytes(item));
+        statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)item->key_len - 1);
+        statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)item->value_len - 1);
+        epochRetire(cache->epoch, item);
+    }
+    cuckooReclaim(cache);
+    pthread_mutex_unlock(&cache->lock);
+    statsAdd(cache->stats, STAT_DELETES, 1);
+}
+
+// No other thread may be using the cache
+void freeCuckooCache(CuckooCache *cache)
+{
+    CuckooTable *table = cache->table;
+    for (size_t i = 0; i <= table->mask; i++)
+    {
+        for (int s = 0; s < CUCKOO_SLOTS; s++)
+        {
+            if (table->buckets[i].tags[s])
+            {
+                free(table->buckets[i].items[s]);
+            }
+        }
+    }
+    free(table->buckets);
+    free(table);
+    epochFree(cache->epoch);
+    free(cache->stats);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+// table_size counts slots, so load_factor is occupancy
+void getCuckooCacheStats(CuckooCache *cache, CacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    statsAggregate(cache->stats, stats);
+    pthread_mutex_lock(&cache->lock);
+    stats->count = cache->count;
+    stats->table_size = (cache->table->mask + 1) * CUCKOO_SLOTS;
+    pthread_mutex_unlock(&cache->lock);
+    stats->bucket_bytes = stats->table_size / CUCKOO_SLOTS * sizeof(CuckooBucket);
+    stats->keyed_hash = 1;
+}
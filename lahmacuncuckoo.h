@@ -0,0 +1,71 @@
+#ifndef LAHMACUNCUCKOO_H
+#define LAHMACUNCUCKOO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacunepoch.h"
+#include "lahmacunstats.h"
+
+// MemC3-style optimistic cuckoo table. Every key has two candidate
+// buckets of CUCKOO_SLOTS slots; a slot holds a one-byte tag from the
+// key's hash and a pointer to the item, so a lookup reads two cache lines
+// of tags and follows a pointer only on a tag match. The second bucket is
+// derived from the first and the tag (partial-key cuckoo hashing), so
+// items can be displaced without rehashing their keys.
+//
+// Writers serialise on one mutex. Readers take no lock: they read the
+// key's version stripe before and after the lookup and retry when a
+// writer touched the stripe meanwhile (a displacement, update or delete
+// bumps it to odd and back). Items are immutable and freed through the
+// epoch domain, like the table arrays a resize replaces.
+#define CUCKOO_SLOTS 4
+#define CUCKOO_INITIAL_BUCKETS 4096
+#define CUCKOO_VERSION_STRIPES 8192
+#define CUCKOO_MAX_DEPTH 5       // displacements per insert (4^5 paths covers the BFS below)
+#define CUCKOO_BFS_NODES 512     // buckets examined looking for a free slot before growing
+#define CUCKOO_READ_RETRIES 8    // optimistic attempts before a reader takes the lock
+
+typedef struct
+{
+    uint64_t hash;
+    time_t expry;
+    uint32_t key_len;
+    uint32_t value_len;
+    char data[]; // key, NUL, value, NUL
+} CuckooItem;
+
+typedef struct
+{
+    uint8_t tags[CUCKOO_SLOTS]; // 0: empty
+    CuckooItem *items[CUCKOO_SLOTS];
+} __attribute__((aligned(CACHE_LINE_SIZE))) CuckooBucket;
+
+typedef struct
+{
+    size_t mask; // buckets - 1
+    CuckooBucket *buckets;
+} CuckooTable;
+
+typedef struct
+{
+    CuckooTable *table;
+    uint64_t seed[2];
+    pthread_mutex_t lock; // writers
+    size_t count;
+    uint64_t writes;
+    uint32_t versions[CUCKOO_VERSION_STRIPES];
+    EpochDomain *epoch;
+    CacheStatsSlot *stats;
+} CuckooCache;
+
+CuckooCache *createCuckooCache(void);
+void setCuckooCache(CuckooCache *cache, const char *key, const char *value, int ttl);
+int getCuckooCache(CuckooCache *cache, const char *key, char *buf, size_t len);
+void deleteCuckooCache(CuckooCache *cache, const char *key);
+void freeCuckooCache(CuckooCache *cache);
+void getCuckooCacheStats(CuckooCache *cache, CacheStats *stats);
+
+#endif
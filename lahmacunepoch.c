@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lahmacunepoch.h"
+
+EpochDomain *epochCreate(void)
+{
+    EpochDomain *domain;
+    if (posix_memalign((void **)&domain, CACHE_LINE_SIZE, sizeof(EpochDomain)) != 0)
+    {
+        return NULL;
+    }
+    memset(domain, 0, sizeof(EpochDomain));
+    return domain;
+}
+
+// Frees everything still retired; no reader may be left
+void epochFree(EpochDomain *domain)
+{
+    EpochRetired *node = domain->retired;
+    while (node)
+    {
+        EpochRetired *next = node->next;
+        node->release(node->ptr);
+        free(node);
+        node = next;
+    }
+    free(domain);
+}
+
+// Called after ptr is unreachable for new readers, with or without the lock
+void epochRetire(EpochDomain *domain, void *ptr)
+{
+    epochRetireWith(domain, ptr, free);
+}
+
+// As epochRetire, for memory that release frees instead of free
+void epochRetireWith(EpochDomain *domain, void *ptr, void (*release)(void *ptr))
+{
+    EpochRetired *node = malloc(sizeof(EpochRetired));
+    node->ptr = ptr;
+    node->release = release;
+    // seq_cst: the unlink must be visible before the epoch is read
+    node->epoch = __atomic_load_n(&domain->global, __ATOMIC_SEQ_CST);
+    node->next = __atomic_load_n(&domain->retired, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&domain->retired, &node->next, node, 1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+    {
+    }
+}
+
+// Advances the epoch if every reader has seen the current one, then frees
+// what was retired two epochs ago. Lock holders only; lock-free
+// structures go through epochTryReclaim.
+void epochReclaim(EpochDomain *domain)
+{
+    if (!__atomic_load_n(&domain->retired, __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    uint64_t global = domain->global;
+    int advance = 1;
+    for (int i = 0; i < STATS_SLOTS && advance; i++)
+    {
+        uint64_t state = __atomic_load_n(&domain->slots[i].state, __ATOMIC_SEQ_CST);
+        advance = !(state & 1) || state >> 1 == global;
+    }
+    if (advance)
+    {
+        __atomic_store_n(&domain->global, ++global, __ATOMIC_RELEASE);
+    }
+
+    EpochRetired *node = __atomic_exchange_n(&domain->retired, NULL, __ATOMIC_ACQUIRE);
+    EpochRetired *keep = NULL, *keep_tail = NULL;
+    while (node)
+    {
+        EpochRetired *next = node->next;
+        if (node->epoch + 2 <= global)
+        {
+            node->release(node->ptr);
+            free(node);
+        }
+        else
+        {
+            node->next = keep;
+            keep = node;
+            keep_tail = keep_tail ? keep_tail : node;
+        }
+        node = next;
+    }
+    if (keep)
+    {
+        keep_tail->next = __atomic_load_n(&domain->retired, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&domain->retired, &keep_tail->next, keep, 1, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+        {
+        }
+    }
+}
+
+// Reclaims unless another thread already is
+void epochTryReclaim(EpochDomain *domain)
+{
+    if (!__atomic_load_n(&domain->retired, __ATOMIC_RELAXED) ||
+        __atomic_exchange_n(&domain->reclaiming, 1, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+    epochReclaim(domain);
+    __atomic_store_n(&domain->reclaiming, 0, __ATOMIC_RELEASE);
+}
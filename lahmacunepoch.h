@@ -0,0 +1,74 @@
+#ifndef LAHMACUNEPOCH_H
+#define LAHMACUNEPOCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lahmacunstats.h"
+
+// Epoch-based reclamation for readers that walk the table without the
+// lock. A reader publishes the global epoch in its thread slot for the
+// length of the walk; memory unlinked by a writer is retired with the
+// epoch of the moment and freed once the epoch has moved on twice, by
+// which time no reader can still hold it. One reclaimer runs at a time:
+// a lock holder, or whoever wins epochTryReclaim.
+typedef struct
+{
+    uint64_t state; // 0 idle, else epoch << 1 | 1
+} __attribute__((aligned(CACHE_LINE_SIZE))) EpochSlot;
+
+typedef struct EpochRetired
+{
+    struct EpochRetired *next;
+    void *ptr;
+    void (*release)(void *ptr);
+    uint64_t epoch;
+} EpochRetired;
+
+typedef struct
+{
+    uint64_t global __attribute__((aligned(CACHE_LINE_SIZE)));
+    EpochRetired *retired __attribute__((aligned(CACHE_LINE_SIZE))); // pushed from anywhere
+    uint32_t reclaiming;
+    EpochSlot slots[STATS_SLOTS];
+} EpochDomain;
+
+EpochDomain *epochCreate(void);
+void epochFree(EpochDomain *domain);
+void epochRetire(EpochDomain *domain, void *ptr);
+void epochRetireWith(EpochDomain *domain, void *ptr, void (*release)(void *ptr));
+void epochReclaim(EpochDomain *domain);
+void epochTryReclaim(EpochDomain *domain);
+
+// -1 when a thread sharing the slot is inside a read section; the caller
+// then takes the lock instead
+static inline int epochEnter(EpochDomain *domain, unsigned int slot)
+{
+    uint64_t expected = 0;
+    uint64_t state = __atomic_load_n(&domain->global, __ATOMIC_ACQUIRE) << 1 | 1;
+    return __atomic_compare_exchange_n(&domain->slots[slot].state, &expected, state, 0, __ATOMIC_SEQ_CST,
+                                       __ATOMIC_RELAXED)
+               ? 0
+               : -1;
+}
+
+// For callers without a lock to fall back on: waits out a thread sharing
+// the slot, which only happens with more than STATS_SLOTS threads
+static inline unsigned int epochEnterSlot(EpochDomain *domain)
+{
+    unsigned int slot = statsThreadSlot();
+    while (epochEnter(domain, slot) != 0)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    return slot;
+}
+
+static inline void epochExit(EpochDomain *domain, unsigned int slot)
+{
+    __atomic_store_n(&domain->slots[slot].state, 0, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+
+#include "lahmacunhash.h"
+
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND(v0, v1, v2, v3)                                   \
+    do                                                             \
+    {                                                              \
+        v0 += v1;                                                  \
+        v1 = ROTL64(v1, 13);                                       \
+        v1 ^= v0;                                                  \
+        v0 = ROTL64(v0, 32);                                       \
+        v2 += v3;                                                  \
+        v3 = ROTL64(v3, 16);                                       \
+        v3 ^= v2;                                                  \
+        v0 += v3;                                                  \
+        v3 = ROTL64(v3, 21);                                       \
+        v3 ^= v0;                                                  \
+        v2 += v1;                                                  \
+        v1 = ROTL64(v1, 17);                                       \
+        v1 ^= v2;                                                  \
+        v2 = ROTL64(v2, 32);                                       \
+    } while (0)
+
+static inline uint64_t loadLe64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+uint64_t sipHash13(const void *data, size_t len, const uint64_t key[2])
+{
+    const uint8_t *in = data;
+    uint64_t v0 = 0x736f6d6570736575ull ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dull ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ull ^ key[0];
+    uint64_t v3 = 0x7465646279746573ull ^ key[1];
+    const uint8_t *end = in + (len & ~(size_t)7);
+
+    for (; in != end; in += 8)
+    {
+        uint64_t m = loadLe64(in);
+        v3 ^= m;
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+
+    uint64_t b = (uint64_t)len << 56;
+    for (size_t i = 0; i < (len & 7); i++)
+    {
+        b |= (uint64_t)in[i] << (8 * i);
+    }
+    v3 ^= b;
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+void hashRandomSeed(uint64_t seed[2])
+{
+    if (getrandom(seed, 2 * sizeof(uint64_t), 0) == (ssize_t)(2 * sizeof(uint64_t)))
+    {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t x = (uint64_t)ts.tv_nsec ^ ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)(uintptr_t)seed;
+    for (int i = 0; i < 2; i++)
+    {
+        // splitmix64
+        x += 0x9e3779b97f4a7c15ull;
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        seed[i] = z ^ (z >> 31);
+    }
+}
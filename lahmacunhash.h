@@ -0,0 +1,15 @@
+#ifndef LAHMACUNHASH_H
+#define LAHMACUNHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SipHash-1-3 keyed with a 128-bit secret. Slower than djb2, but without
+// the key an attacker cannot build colliding keys, so a table switches to
+// it once its chains look flooded.
+uint64_t sipHash13(const void *data, size_t len, const uint64_t key[2]);
+
+// 128 bits from the kernel, or a clock/address mix if that fails
+void hashRandomSeed(uint64_t seed[2]);
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "lahmacunhist.h"
+
+static double ticks_per_ns;
+
+static uint64_t monotonicNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Measured once against CLOCK_MONOTONIC over ~10ms
+double histTicksPerNs(void)
+{
+    double cached;
+    __atomic_load(&ticks_per_ns, &cached, __ATOMIC_RELAXED);
+    if (cached > 0)
+    {
+        return cached;
+    }
+    uint64_t ns0 = monotonicNanos();
+    uint64_t t0 = histTicks();
+    while (monotonicNanos() - ns0 < 10000000)
+    {
+    }
+    uint64_t t1 = histTicks();
+    uint64_t ns1 = monotonicNanos();
+    cached = (double)(t1 - t0) / (double)(ns1 - ns0);
+    __atomic_store(&ticks_per_ns, &cached, __ATOMIC_RELAXED);
+    return cached;
+}
+
+uint64_t histBucketLow(unsigned int index)
+{
+    if (index < HIST_SUB_COUNT)
+    {
+        return index;
+    }
+    unsigned int mag = index / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    uint64_t sub = index % HIST_SUB_COUNT;
+    return (HIST_SUB_COUNT + sub) << (mag - HIST_SUB_BITS);
+}
+
+uint64_t histBucketHigh(unsigned int index)
+{
+    if (index < HIST_SUB_COUNT)
+    {
+        return index;
+    }
+    unsigned int mag = index / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+    return histBucketLow(index) + (1ull << (mag - HIST_SUB_BITS)) - 1;
+}
+
+void histMerge(Histogram *dst, const Histogram *src)
+{
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    {
+        dst->counts[i] += __atomic_load_n(&src->counts[i], __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t histTotal(const Histogram *h)
+{
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    {
+        total += h->counts[i];
+    }
+    return total;
+}
+
+// Upper bound of the bucket holding the given percentile (0-100)
+uint64_t histPercentile(const Histogram *h, double percentile)
+{
+    uint64_t total = histTotal(h);
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * (double)total);
+    uint64_t seen = 0;
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= rank)
+        {
+            return histBucketHigh(i);
+        }
+    }
+    return 0;
+}
+
+uint64_t histMax(const Histogram *h)
+{
+    for (unsigned int i = HIST_BUCKETS; i > 0; i--)
+    {
+        if (h->counts[i - 1])
+        {
+            return histBucketHigh(i - 1);
+        }
+    }
+    return 0;
+}
+
+// Bucket midpoints, so within the bucket precision
+double histMean(const Histogram *h)
+{
+    double sum = 0;
+    uint64_t total = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    {
+        if (h->counts[i])
+        {
+            sum += (double)h->counts[i] * ((double)histBucketLow(i) + (double)histBucketHigh(i)) / 2.0;
+            total += h->counts[i];
+        }
+    }
+    return total ? sum / (double)total : 0.0;
+}
+
+// HdrHistogram's percentile distribution (.hgrm) text format, readable by
+// its plotting tools. Values are divided by unit_per_value.
+void histExport(const Histogram *h, FILE *file, double unit_per_value)
+{
+    uint64_t total = histTotal(h);
+    fprintf(file, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    uint64_t seen = 0;
+    double sum = 0, sum_sq = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+    {
+        if (!h->counts[i])
+        {
+            continue;
+        }
+        double value = (double)histBucketHigh(i) / unit_per_value;
+        seen += h->counts[i];
+        sum += value * (double)h->counts[i];
+        sum_sq += value * value * (double)h->counts[i];
+        double fraction = (double)seen / (double)total;
+        if (seen < total)
+        {
+            fprintf(file, "%12.3f %2.12f %10llu %14.2f\n", value, fraction,
+                    (unsigned long long)seen, 1.0 / (1.0 - fraction));
+        }
+        else
+        {
+            fprintf(file, "%12.3f %2.12f %10llu\n", value, fraction, (unsigned long long)seen);
+        }
+    }
+
+    double mean = total ? sum / (double)total : 0.0;
+    double variance = total ? sum_sq / (double)total - mean * mean : 0.0;
+    fprintf(file, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean, sqrt(variance > 0 ? variance : 0));
+    fprintf(file, "#[Max     = %12.3f, Total count    = %12llu]\n",
+            (double)histMax(h) / unit_per_value, (unsigned long long)total);
+    fprintf(file, "#[Buckets = %12d, SubBuckets     = %12d]\n", HIST_MAX_BITS - HIST_SUB_BITS + 1, HIST_SUB_COUNT);
+}
@@ -0,0 +1,77 @@
+#ifndef LAHMACUNHIST_H
+#define LAHMACUNHIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// HdrHistogram-style log-linear buckets: values below HIST_SUB_COUNT are
+// exact, above that every power of two is split into HIST_SUB_COUNT linear
+// buckets (~3% relative precision). Values at or past 2^HIST_MAX_BITS land
+// in the last bucket. Units are up to the caller (ticks, ns, ...).
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 44
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct
+{
+    uint64_t counts[HIST_BUCKETS];
+} Histogram;
+
+static inline unsigned int histIndex(uint64_t value)
+{
+    if (value < HIST_SUB_COUNT)
+    {
+        return (unsigned int)value;
+    }
+    unsigned int mag = 63 - (unsigned int)__builtin_clzll(value);
+    if (mag >= HIST_MAX_BITS)
+    {
+        return HIST_BUCKETS - 1;
+    }
+    return (mag - HIST_SUB_BITS + 1) * HIST_SUB_COUNT +
+           (unsigned int)((value >> (mag - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+// Single writer per histogram: a plain relaxed increment, no locked
+// instruction. Readers may see a count one behind.
+static inline void histRecord(Histogram *h, uint64_t value)
+{
+    uint64_t *count = &h->counts[histIndex(value)];
+    __atomic_store_n(count, __atomic_load_n(count, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+// Cheapest monotonic tick source available: the TSC on x86, the virtual
+// counter on arm64, CLOCK_MONOTONIC nanoseconds elsewhere
+static inline uint64_t histTicks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+double histTicksPerNs(void);
+
+uint64_t histBucketLow(unsigned int index);
+uint64_t histBucketHigh(unsigned int index);
+void histMerge(Histogram *dst, const Histogram *src);
+uint64_t histTotal(const Histogram *h);
+uint64_t histPercentile(const Histogram *h, double percentile);
+uint64_t histMax(const Histogram *h);
+double histMean(const Histogram *h);
+void histExport(const Histogram *h, FILE *file, double unit_per_value);
+
+#endif
@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "lahmacunhot.h"
+
+// Ends a window: promote the keys above the share threshold, then decay
+static void hotWindow(HotKeys *hot)
+{
+    unsigned int previous = hot->hot_keys;
+    uint64_t previous_hot[HOT_KEYS];
+    memcpy(previous_hot, hot->hot, sizeof(previous_hot));
+
+    hot->hot_keys = 0;
+    for (unsigned int i = 0; i < hot->used; i++)
+    {
+        const HotCounter *c = &hot->counters[i];
+        uint64_t guaranteed = c->count - c->error;
+        if (guaranteed * HOT_SHARE < hot->window_samples)
+        {
+            continue;
+        }
+        // insertion into the top HOT_KEYS by guaranteed count
+        unsigned int pos = hot->hot_keys < HOT_KEYS ? hot->hot_keys : HOT_KEYS;
+        while (pos > 0 && hot->hot_count[pos - 1] < guaranteed)
+        {
+            if (pos < HOT_KEYS)
+            {
+                hot->hot[pos] = hot->hot[pos - 1];
+                hot->hot_count[pos] = hot->hot_count[pos - 1];
+                memcpy(hot->hot_key[pos], hot->hot_key[pos - 1], HOT_KEY_PREFIX);
+            }
+            pos--;
+        }
+        if (pos < HOT_KEYS)
+        {
+            hot->hot[pos] = c->hash;
+            hot->hot_count[pos] = guaranteed;
+            memcpy(hot->hot_key[pos], c->key, HOT_KEY_PREFIX);
+            if (hot->hot_keys < HOT_KEYS)
+            {
+                hot->hot_keys++;
+            }
+        }
+    }
+    for (unsigned int i = 0; i < hot->hot_keys; i++)
+    {
+        int was_hot = 0;
+        for (unsigned int j = 0; j < previous; j++)
+        {
+            was_hot |= previous_hot[j] == hot->hot[i];
+        }
+        hot->promotions += !was_hot;
+    }
+
+    for (unsigned int i = 0; i < hot->used; i++)
+    {
+        hot->counters[i].count /= 2;
+        hot->counters[i].error /= 2;
+    }
+    hot->window_samples = 0;
+}
+
+static void hotAdd(HotKeys *hot, uint64_t hash, const char *key, uint64_t weight)
+{
+    HotCounter *found = NULL, *min = NULL;
+    hot->samples += weight;
+    hot->window_samples += weight;
+    for (unsigned int i = 0; i < hot->used && !found; i++)
+    {
+        HotCounter *c = &hot->counters[i];
+        if (c->hash == hash)
+        {
+            found = c;
+        }
+        else if (!min || c->count < min->count)
+        {
+            min = c;
+        }
+    }
+    if (found)
+    {
+        found->count += weight;
+        return;
+    }
+    if (hot->used < HOT_COUNTERS)
+    {
+        min = &hot->counters[hot->used++];
+        min->count = 0;
+    }
+    // take over the smallest counter; its count becomes the newcomer's error
+    min->hash = hash;
+    min->error = min->count;
+    min->count += weight;
+    strncpy(min->key, key, HOT_KEY_PREFIX - 1);
+    min->key[HOT_KEY_PREFIX - 1] = '\0';
+}
+
+void hotSample(HotKeys *hot, uint64_t hash, const char *key)
+{
+    hotAdd(hot, hash, key, 1);
+    if (hot->window_samples >= HOT_WINDOW)
+    {
+        hotWindow(hot);
+    }
+}
+
+void hotCredit(HotKeys *hot, uint64_t hash, const char *key, uint64_t samples)
+{
+    hotAdd(hot, hash, key, samples);
+}
@@ -0,0 +1,57 @@
+#ifndef LAHMACUNHOT_H
+#define LAHMACUNHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Space-Saving heavy hitter detector (Metwally et al.) over sampled gets.
+// HOT_COUNTERS counters track the most frequent key hashes seen; at the
+// end of every window of HOT_WINDOW samples, keys estimated at more than
+// 1/HOT_SHARE of the window become the hot set (at most HOT_KEYS) and all
+// counts are halved, so a key that cools down drops out after a few
+// windows. Not thread safe: the cache updates it under Cache.lock.
+#define HOT_COUNTERS 64
+#define HOT_KEYS 8
+#define HOT_WINDOW 1024
+#define HOT_SHARE 64
+#define HOT_KEY_PREFIX 64 // bytes of the key kept for reporting
+
+typedef struct
+{
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error; // count the key may have inherited from the one it replaced
+    char key[HOT_KEY_PREFIX];
+} HotCounter;
+
+typedef struct
+{
+    HotCounter counters[HOT_COUNTERS];
+    unsigned int used;
+    uint64_t window_samples;
+    uint64_t samples;
+    uint64_t hot[HOT_KEYS];
+    uint64_t hot_count[HOT_KEYS]; // guaranteed count at promotion
+    char hot_key[HOT_KEYS][HOT_KEY_PREFIX];
+    unsigned int hot_keys;
+    uint64_t promotions;
+} HotKeys;
+
+void hotSample(HotKeys *hot, uint64_t hash, const char *key);
+// Counts reads the cache served without sampling them (replica hits) as
+// that many samples, so a replicated key stays hot while it is being read
+void hotCredit(HotKeys *hot, uint64_t hash, const char *key, uint64_t samples);
+
+static inline int hotIsHot(const HotKeys *hot, uint64_t hash)
+{
+    for (unsigned int i = 0; i < hot->hot_keys; i++)
+    {
+        if (hot->hot[i] == hash)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lahmacunint.h"
+
+static inline size_t homeSlot(const IntCache *cache, uint64_t key)
+{
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> cache->shift);
+}
+
+static inline int64_t valueBytes(const IntValue *value)
+{
+    return (int64_t)(sizeof(IntValue) + value->len + 1);
+}
+
+// The slot holding key, or the empty slot that ends its run
+static inline size_t findSlot(const IntCache *cache, uint64_t key)
+{
+    size_t index = homeSlot(cache, key);
+    while (cache->slots[index].value && cache->slots[index].key != key)
+    {
+        index = (index + 1) & cache->mask;
+    }
+    return index;
+}
+
+// Empties index and moves back every later entry of the run that may not
+// be left past the hole: one whose home slot is not between the hole and
+// itself (Knuth's algorithm R)
+static void removeAt(IntCache *cache, size_t index)
+{
+    size_t next = index;
+    for (;;)
+    {
+        next = (next + 1) & cache->mask;
+        const IntSlot *slot = &cache->slots[next];
+        if (!slot->value)
+        {
+            break;
+        }
+        size_t home = homeSlot(cache, slot->key);
+        int stays = index <= next ? index < home && home <= next : index < home || home <= next;
+        if (!stays)
+        {
+            cache->slots[index] = *slot;
+            index = next;
+        }
+    }
+    cache->slots[index].value = NULL;
+    cache->count--;
+}
+
+// -1 when the new table cannot be allocated; the old one stays
+static int intGrow(IntCache *cache)
+{
+    IntSlot *old = cache->slots;
+    size_t old_size = cache->mask + 1;
+    IntSlot *slots = calloc(old_size * 2, sizeof(IntSlot));
+    if (!slots)
+    {
+        return -1;
+    }
+    cache->slots = slots;
+    cache->mask = old_size * 2 - 1;
+    cache->shift--;
+    for (size_t i = 0; i < old_size; i++)
+    {
+        if (old[i].value)
+        {
+            cache->slots[findSlot(cache, old[i].key)] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+IntCache *createIntCache(void)
+{
+    IntCache *cache = calloc(1, sizeof(IntCache));
+    cache->slots = calloc(INT_INITIAL_SLOTS, sizeof(IntSlot));
+    cache->mask = INT_INITIAL_SLOTS - 1;
+    cache->shift = 64 - (unsigned int)__builtin_ctzll(INT_INITIAL_SLOTS);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->stats = statsCreate();
+    return cache;
+}
+
+void setIntCache(IntCache *cache, uint64_t key, const char *value, int ttl)
+{
+    size_t len = strlen(value);
+    IntValue *stored = malloc(sizeof(IntValue) + len + 1);
+    stored->expry = time(NULL) + ttl;
+    stored->len = (uint32_t)len;
+    memcpy(stored->data, value, len + 1);
+    int64_t new_bytes = valueBytes(stored);
+
+    // A new key is only stored if the table is below its load limit, so
+    // findSlot always has an empty slot to stop at
+    int room = 1;
+    pthread_mutex_lock(&cache->lock);
+    if ((cache->count + 1) * 100 > (cache->mask + 1) * INT_MAX_LOAD_PERCENT)
+    {
+        room = intGrow(cache) == 0;
+    }
+    IntSlot *slot = &cache->slots[findSlot(cache, key)];
+    IntValue *old = slot->value;
+    if (old || room)
+    {
+        slot->key = key;
+        slot->value = stored;
+        cache->count += !old;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_SETS, 1);
+    if (!old && !room)
+    {
+        statsAdd(cache->stats, STAT_DROPPED_SETS, 1);
+        free(stored);
+        return;
+    }
+    statsAdd(cache->stats, STAT_ENTRY_BYTES, new_bytes - (old ? valueBytes(old) : 0));
+    statsAdd(cache->stats, STAT_VALUE_BYTES, (int64_t)len - (old ? (int64_t)old->len : -1));
+    free(old);
+}
+
+// Copies the value like getCacheCopy: full length, or -1 when absent.
+// An expired value is deleted by the get that finds it.
+int getIntCache(IntCache *cache, uint64_t key, char *buf, size_t len)
+{
+    IntValue *expired = NULL;
+    int n = -1;
+    pthread_mutex_lock(&cache->lock);
+    size_t index = findSlot(cache, key);
+    IntValue *value = cache->slots[index].value;
+    if (value && time(NULL) >= value->expry)
+    {
+        expired = value;
+        removeAt(cache, index);
+    }
+    else if (value)
+    {
+        if (len)
+        {
+            size_t copy = value->len < len ? value->len : len - 1;
+            memcpy(buf, value->data, copy);
+            buf[copy] = '\0';
+        }
+        n = (int)value->len;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_GETS, 1);
+    statsAdd(cache->stats, n >= 0 ? STAT_HITS : STAT_MISSES, 1);
+    if (expired)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, 1);
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -valueBytes(expired));
+        statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)expired->len - 1);
+        free(expired);
+    }
+    return n;
+}
+
+void deleteIntCache(IntCache *cache, uint64_t key)
+{
+    pthread_mutex_lock(&cache->lock);
+    size_t index = findSlot(cache, key);
+    IntValue *value = cache->slots[index].value;
+    if (value)
+    {
+        removeAt(cache, index);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_DELETES, 1);
+    if (value)
+    {
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -valueBytes(value));
+        statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)value->len - 1);
+        free(value);
+    }
+}
+
+// No other thread may be using the cache
+void freeIntCache(IntCache *cache)
+{
+    for (size_t i = 0; i <= cache->mask; i++)
+    {
+        free(cache->slots[i].value);
+    }
+    free(cache->slots);
+    free(cache->stats);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+// Keys live in the slots, so key_bytes stays 0 and they count towards
+// bucket_bytes. The probe section reports every key's exact probe length.
+void getIntCacheStats(IntCache *cache, CacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    statsAggregate(cache->stats, stats);
+    TableHealth *h = &stats->health;
+    pthread_mutex_lock(&cache->lock);
+    stats->count = cache->count;
+    stats->table_size = cache->mask + 1;
+    for (size_t i = 0; i <= cache->mask; i++)
+    {
+        const IntSlot *slot = &cache->slots[i];
+        if (slot->value)
+        {
+            uint64_t length = ((i - homeSlot(cache, slot->key)) & cache->mask) + 1;
+            h->samples++;
+            h->length_sum += length;
+            h->length_max = length > h->length_max ? length : h->length_max;
+            h->lengths[probeHistBucket(length)]++;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    h->ops = h->samples;
+    stats->bucket_bytes = stats->table_size * sizeof(IntSlot);
+    stats->hash_function = "fibonacci";
+}
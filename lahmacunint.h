@@ -0,0 +1,52 @@
+#ifndef LAHMACUNINT_H
+#define LAHMACUNINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacunstats.h"
+
+// Table for 64-bit integer keys, for callers that would otherwise format
+// an ID into a string just to store it. The key sits in the slot next to
+// the value pointer, so a probe is one integer compare with no hashing of
+// strings and no strcmp. Slots are found by Fibonacci (multiplicative)
+// hashing and linear probing, and deletes move later entries of the run
+// back instead of leaving tombstones. The hash is not keyed: keys chosen
+// to collide can degrade it, which is fine for IDs the caller assigns.
+// One mutex guards the table, like Cache.
+#define INT_INITIAL_SLOTS 4096
+#define INT_MAX_LOAD_PERCENT 70 // grow when count reaches this share of the slots
+
+typedef struct
+{
+    time_t expry;
+    uint32_t len; // terminator excluded
+    char data[];
+} IntValue;
+
+typedef struct
+{
+    uint64_t key;
+    IntValue *value; // NULL: empty
+} IntSlot;
+
+typedef struct
+{
+    IntSlot *slots;
+    size_t mask;        // slots - 1
+    unsigned int shift; // 64 - log2(slots)
+    size_t count;
+    pthread_mutex_t lock;
+    CacheStatsSlot *stats;
+} IntCache;
+
+IntCache *createIntCache(void);
+void setIntCache(IntCache *cache, uint64_t key, const char *value, int ttl);
+int getIntCache(IntCache *cache, uint64_t key, char *buf, size_t len);
+void deleteIntCache(IntCache *cache, uint64_t key);
+void freeIntCache(IntCache *cache);
+void getIntCacheStats(IntCache *cache, CacheStats *stats);
+
+#endif
@@ -0,0 +1,34 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "lahmacunnear.h"
+
+_Thread_local NearCache *near_local;
+
+static pthread_key_t near_key;
+static pthread_once_t near_key_once = PTHREAD_ONCE_INIT;
+
+static void nearCreateKey(void)
+{
+    // frees the thread's L1 when it exits
+    pthread_key_create(&near_key, free);
+}
+
+// Rebinds this thread's L1 to another cache, emptying it
+NearCache *nearAttach(uint64_t cache_id, size_t slots)
+{
+    NearCache *near = near_local;
+    if (!near || near->mask + 1 != slots)
+    {
+        pthread_once(&near_key_once, nearCreateKey);
+        free(near);
+        near = malloc(sizeof(NearCache) + slots * sizeof(NearSlot));
+        near->mask = slots - 1;
+        near_local = near;
+        pthread_setspecific(near_key, near);
+    }
+    memset(near->slots, 0, slots * sizeof(NearSlot));
+    near->cache_id = cache_id;
+    return near;
+}
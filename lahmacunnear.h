@@ -0,0 +1,56 @@
+#ifndef LAHMACUNNEAR_H
+#define LAHMACUNNEAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Thread-local direct-mapped near cache (L1) in front of getCache. A slot
+// remembers where the shared cache keeps a key's entry and the version of
+// the key's stripe when it was filled. Writers bump the stripe under
+// Cache.lock, so an L1 hit only reads: its own slot, the stripe counter
+// and the entry itself. A write to any key of the stripe drops the slot.
+#define NEAR_VERSION_STRIPES 4096
+
+typedef struct
+{
+    uint64_t hash;
+    const void *entry; // CacheEntry; NULL when empty
+    uint64_t version;
+} NearSlot;
+
+// One per thread, bound to one cache at a time: a thread that reads from
+// two near-cached caches in turn refills on every switch
+typedef struct
+{
+    uint64_t cache_id;
+    size_t mask;
+    NearSlot slots[];
+} NearCache;
+
+extern _Thread_local NearCache *near_local;
+
+NearCache *nearAttach(uint64_t cache_id, size_t slots);
+
+static inline NearCache *nearFor(uint64_t cache_id, size_t slots)
+{
+    NearCache *near = near_local;
+    return near && near->cache_id == cache_id ? near : nearAttach(cache_id, slots);
+}
+
+// FNV-1a; the slot uses the low bits, the version stripe the high ones
+static inline uint64_t nearHash(const char *key)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    while (*key)
+    {
+        h = (h ^ (unsigned char)*key++) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static inline size_t nearStripe(uint64_t hash)
+{
+    return (size_t)(hash >> 52) & (NEAR_VERSION_STRIPES - 1);
+}
+
+#endif
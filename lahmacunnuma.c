@@ -0,0 +1,108 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "lahmacunnuma.h"
+
+static struct
+{
+    int nodes;
+    int16_t cpu_node[CPU_SETSIZE];
+    cpu_set_t cpus[NUMA_MAX_NODES];
+} topology;
+
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+static __thread int thread_node = -1;
+
+// A cpulist such as "0-7,16-23" into cpus; the number of CPUs read
+static int parseCpuList(const char *list, cpu_set_t *cpus)
+{
+    int count = 0;
+    const char *p = list;
+    while (*p >= '0' && *p <= '9')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (*end == '-')
+        {
+            last = strtol(end + 1, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+        {
+            CPU_SET((int)cpu, cpus);
+            count++;
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+static void topologyLoad(void)
+{
+    char path[64];
+    char list[4096];
+    for (int id = 0; id < NUMA_MAX_NODES * 4 && topology.nodes < NUMA_MAX_NODES; id++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        FILE *file = fopen(path, "r");
+        if (!file)
+        {
+            continue;
+        }
+        cpu_set_t *cpus = &topology.cpus[topology.nodes];
+        CPU_ZERO(cpus);
+        // Memory-only nodes have no CPUs to pin to and are skipped
+        if (fgets(list, sizeof(list), file) && parseCpuList(list, cpus) > 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, cpus))
+                {
+                    topology.cpu_node[cpu] = (int16_t)topology.nodes;
+                }
+            }
+            topology.nodes++;
+        }
+        fclose(file);
+    }
+    if (topology.nodes == 0)
+    {
+        topology.nodes = 1;
+        sched_getaffinity(0, sizeof(cpu_set_t), &topology.cpus[0]);
+    }
+}
+
+int numaNodeCount(void)
+{
+    pthread_once(&topology_once, topologyLoad);
+    return topology.nodes;
+}
+
+int numaCpuNode(int cpu)
+{
+    pthread_once(&topology_once, topologyLoad);
+    return cpu >= 0 && cpu < CPU_SETSIZE ? topology.cpu_node[cpu] : 0;
+}
+
+int numaPinThread(int node)
+{
+    if (node < 0 || node >= numaNodeCount())
+    {
+        return -1;
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &topology.cpus[node]) != 0)
+    {
+        return -1;
+    }
+    thread_node = node;
+    return 0;
+}
+
+int numaThreadNode(void)
+{
+    return thread_node >= 0 ? thread_node : numaCpuNode(sched_getcpu());
+}
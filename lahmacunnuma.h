@@ -0,0 +1,21 @@
+#ifndef LAHMACUNNUMA_H
+#define LAHMACUNNUMA_H
+
+// NUMA topology from /sys/devices/system/node, without libnuma. Nodes are
+// numbered densely in the kernel's order; a machine without NUMA (or
+// without sysfs) is one node holding every CPU. Memory placement is left
+// to the kernel's default local policy: a page lands on the node of the
+// thread that first touches it, so a thread pinned with numaPinThread
+// before it allocates and writes its data keeps that data local.
+#define NUMA_MAX_NODES 64
+
+int numaNodeCount(void);
+// The node of cpu, 0 for CPUs the topology does not list
+int numaCpuNode(int cpu);
+// Pins the calling thread to the CPUs of node and records node for
+// numaThreadNode; 0, or -1 when node does not exist or the pin failed
+int numaPinThread(int node);
+// The node numaPinThread recorded, else that of the CPU the thread runs on
+int numaThreadNode(void);
+
+#endif
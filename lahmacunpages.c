@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "lahmacunpages.h"
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26)
+#endif
+
+static inline PageHeader *headerOf(const void *ptr)
+{
+    return (PageHeader *)((char *)ptr - sizeof(PageHeader));
+}
+
+// length bytes at a 2 MB boundary: over-map by one huge page and trim
+static void *mapAligned(size_t length)
+{
+    char *raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+    {
+        return NULL;
+    }
+    char *base = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (base > raw)
+    {
+        munmap(raw, (size_t)(base - raw));
+    }
+    size_t tail = (size_t)(raw + length + HUGE_PAGE_SIZE - (base + length));
+    if (tail)
+    {
+        munmap(base + length, tail);
+    }
+    return base;
+}
+
+// Requests under half a huge page get ordinary pages: a 2 MB page for a
+// small table would mostly hold nothing
+void *pagesAlloc(size_t bytes, PageKind *kind)
+{
+    size_t needed = bytes + sizeof(PageHeader);
+    PageKind got = PAGES_SMALL;
+    void *base = NULL;
+    size_t length;
+    if (needed < HUGE_PAGE_SIZE / 2)
+    {
+        length = (needed + 4095) & ~(size_t)4095;
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        base = base == MAP_FAILED ? NULL : base;
+    }
+    else
+    {
+        length = (needed + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB,
+                    -1, 0);
+        if (base != MAP_FAILED)
+        {
+            got = PAGES_HUGETLB;
+        }
+        else if ((base = mapAligned(length)))
+        {
+            madvise(base, length, MADV_HUGEPAGE);
+            got = PAGES_THP;
+        }
+    }
+    if (!base)
+    {
+        return NULL;
+    }
+    PageHeader *header = base;
+    header->length = length;
+    header->kind = got;
+    header->owner = NULL;
+    if (kind)
+    {
+        *kind = got;
+    }
+    return header + 1;
+}
+
+void pagesFree(void *ptr)
+{
+    if (ptr)
+    {
+        PageHeader *header = headerOf(ptr);
+        munmap(header, header->length);
+    }
+}
+
+size_t pagesMapped(const void *ptr)
+{
+    return ptr ? headerOf(ptr)->length : 0;
+}
+
+PageKind pagesKind(const void *ptr)
+{
+    return ptr ? headerOf(ptr)->kind : PAGES_SMALL;
+}
+
+void arenaInit(PageArena *arena, size_t slot_size)
+{
+    memset(arena, 0, sizeof(*arena));
+    pthread_mutex_init(&arena->lock, NULL);
+    arena->slot_size = (slot_size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+}
+
+// Called with the arena lock held
+static int arenaGrow(PageArena *arena)
+{
+    PageKind kind;
+    char *chunk = pagesAlloc(HUGE_PAGE_SIZE - sizeof(PageHeader), &kind);
+    if (!chunk)
+    {
+        return -1;
+    }
+    headerOf(chunk)->owner = arena;
+    *(void **)chunk = arena->chunks;
+    arena->chunks = chunk;
+    arena->chunk_count++;
+    arena->huge_chunks += kind != PAGES_SMALL;
+    arena->next = chunk + arena->slot_size;
+    arena->end = chunk + HUGE_PAGE_SIZE - sizeof(PageHeader);
+    return 0;
+}
+
+void *arenaAlloc(PageArena *arena)
+{
+    pthread_mutex_lock(&arena->lock);
+    void *slot = arena->free_slots;
+    if (slot)
+    {
+        arena->free_slots = *(void **)slot;
+    }
+    else if ((size_t)(arena->end - arena->next) >= arena->slot_size || arenaGrow(arena) == 0)
+    {
+        slot = arena->next;
+        arena->next += arena->slot_size;
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return slot;
+}
+
+void arenaFree(void *slot)
+{
+    PageHeader *header = (PageHeader *)((uintptr_t)slot & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    PageArena *arena = header->owner;
+    pthread_mutex_lock(&arena->lock);
+    *(void **)slot = arena->free_slots;
+    arena->free_slots = slot;
+    pthread_mutex_unlock(&arena->lock);
+}
+
+void arenaDestroy(PageArena *arena)
+{
+    void *chunk = arena->chunks;
+    while (chunk)
+    {
+        void *next = *(void **)chunk;
+        pagesFree(chunk);
+        chunk = next;
+    }
+    pthread_mutex_destroy(&arena->lock);
+    memset(arena, 0, sizeof(*arena));
+}
+
+// Bytes of chunks mapped, and in *huge those on 2 MB pages
+size_t arenaMapped(PageArena *arena, size_t *huge)
+{
+    pthread_mutex_lock(&arena->lock);
+    size_t mapped = arena->chunk_count * HUGE_PAGE_SIZE;
+    *huge = arena->huge_chunks * HUGE_PAGE_SIZE;
+    pthread_mutex_unlock(&arena->lock);
+    return mapped;
+}
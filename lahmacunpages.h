@@ -0,0 +1,64 @@
+#ifndef LAHMACUNPAGES_H
+#define LAHMACUNPAGES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "lahmacunstats.h"
+
+// 2 MB pages for the table's large, randomly accessed memory. With
+// millions of buckets and entries nearly every lookup lands on a different
+// 4 KB page, and a TLB miss costs a page walk on top of the cache miss;
+// one 2 MB TLB entry covers 512 times as much. Mappings come from the
+// hugetlbfs pool (MAP_HUGETLB) when the system has reserved pages
+// (vm.nr_hugepages), else from a 2 MB aligned mapping advised with
+// MADV_HUGEPAGE for transparent huge pages.
+//
+// A mapping starts with one cache line of PageHeader, so pagesFree needs
+// nothing but the pointer and can be passed to epochRetireWith.
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+typedef enum
+{
+    PAGES_SMALL,   // ordinary pages: the request was too small, or 2 MB alignment failed
+    PAGES_THP,     // aligned and advised; the kernel backs it when it has free 2 MB pages
+    PAGES_HUGETLB, // reserved huge pages
+} PageKind;
+
+typedef struct
+{
+    size_t length; // of the whole mapping
+    PageKind kind;
+    void *owner; // the arena a slab chunk belongs to
+} __attribute__((aligned(CACHE_LINE_SIZE))) PageHeader;
+
+// Zeroed memory for bytes, or NULL
+void *pagesAlloc(size_t bytes, PageKind *kind);
+void pagesFree(void *ptr);
+size_t pagesMapped(const void *ptr);
+PageKind pagesKind(const void *ptr);
+
+// Slab of fixed-size slots carved from 2 MB aligned chunks. A freed slot
+// goes on the free list for reuse; chunks are unmapped only by
+// arenaDestroy. The chunk header at the start of each 2 MB block names
+// the arena, so arenaFree takes just the slot. One mutex guards it.
+typedef struct PageArena
+{
+    pthread_mutex_t lock;
+    size_t slot_size;
+    void *free_slots;
+    char *next; // bump pointer into the newest chunk
+    char *end;
+    void *chunks; // newest first, linked through the chunk's first slot
+    size_t chunk_count;
+    size_t huge_chunks; // chunks not on PAGES_SMALL
+} PageArena;
+
+void arenaInit(PageArena *arena, size_t slot_size);
+void *arenaAlloc(PageArena *arena);
+void arenaFree(void *slot);
+void arenaDestroy(PageArena *arena);
+size_t arenaMapped(PageArena *arena, size_t *huge);
+
+#endif
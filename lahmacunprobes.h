@@ -0,0 +1,77 @@
+#ifndef LAHMACUNPROBES_H
+#define LAHMACUNPROBES_H
+
+// USDT static tracepoints for bpftrace/perf/systemtap. Built only with
+// -DLAHMACUN_USDT on systems that ship <sys/sdt.h> (systemtap-sdt-dev);
+// otherwise every probe compiles to nothing. When built in, a probe is a
+// nop plus a test of its semaphore, and its arguments are only computed
+// while a tracer is attached.
+//
+//   lahmacun:get-hit        key_len, bucket, chain position of the hit
+//   lahmacun:get-miss       key_len, bucket, chain length walked
+//   lahmacun:set            key_len, bucket, chain length before insert
+//   lahmacun:delete         key_len, bucket, chain position (0 if absent)
+//   lahmacun:expire         key_len, bucket, chain position
+//   lahmacun:resize-start   old table size, entry count
+//   lahmacun:resize-end     new table size, entry count
+//   lahmacun:lock-acquire   LockSite, contended, wait ticks
+//
+// There is no eviction policy yet, so there is no evict probe.
+//
+//   bpftrace -e 'usdt:./lahmacuncache:lahmacun:get-miss { @chain = lhist(arg2, 0, 32, 1); }'
+//
+// Only lahmacuncache.c includes this header: the semaphores are static.
+
+#if defined(LAHMACUN_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define LAHMACUN_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef LAHMACUN_HAVE_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define CACHE_PROBE_SEMAPHORE(name) \
+    static volatile unsigned short lahmacun_##name##_semaphore __attribute__((unused, section(".probes")))
+
+CACHE_PROBE_SEMAPHORE(get__hit);
+CACHE_PROBE_SEMAPHORE(get__miss);
+CACHE_PROBE_SEMAPHORE(set);
+CACHE_PROBE_SEMAPHORE(delete);
+CACHE_PROBE_SEMAPHORE(expire);
+CACHE_PROBE_SEMAPHORE(resize__start);
+CACHE_PROBE_SEMAPHORE(resize__end);
+CACHE_PROBE_SEMAPHORE(lock__acquire);
+
+#define CACHE_PROBE_ENABLED(name) __builtin_expect(lahmacun_##name##_semaphore != 0, 0)
+
+#define CACHE_PROBE2(name, a, b)                  \
+    do                                            \
+    {                                             \
+        if (CACHE_PROBE_ENABLED(name))            \
+        {                                         \
+            STAP_PROBE2(lahmacun, name, a, b);    \
+        }                                         \
+    } while (0)
+
+#define CACHE_PROBE3(name, a, b, c)               \
+    do                                            \
+    {                                             \
+        if (CACHE_PROBE_ENABLED(name))            \
+        {                                         \
+            STAP_PROBE3(lahmacun, name, a, b, c); \
+        }                                         \
+    } while (0)
+
+#else
+
+// sizeof keeps the arguments "used" without evaluating them
+#define CACHE_PROBE_ENABLED(name) 0
+#define CACHE_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define CACHE_PROBE3(name, a, b, c) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+
+#endif
+
+#endif
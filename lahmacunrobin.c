@@ -0,0 +1,292 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lahmacunhash.h"
+#include "lahmacunrobin.h"
+
+#define ROBIN_MAX_SLOTS (1ull << 32)
+
+static inline const char *itemValue(const RobinItem *item)
+{
+    return item->data + item->key_len + 1;
+}
+
+static inline int64_t itemBytes(const RobinItem *item)
+{
+    return (int64_t)(sizeof(RobinItem) + item->key_len + item->value_len + 2);
+}
+
+static inline int slotMatches(const RobinSlot *slot, uint32_t hash, const char *key, size_t key_len)
+{
+    return slot->hash == hash && slot->item->key_len == key_len && memcmp(slot->item->data, key, key_len) == 0;
+}
+
+// Robin Hood placement starting at index, where the carried item is
+// distance - 1 slots from home: whenever it meets a slot that is closer
+// to home, the two swap and the evicted item is carried on
+static void placeFrom(RobinSlot *slots, size_t mask, size_t index, uint32_t distance, uint32_t hash, RobinItem *item)
+{
+    RobinSlot carried = {hash, distance, item};
+    for (;;)
+    {
+        RobinSlot *slot = &slots[index];
+        if (!slot->distance)
+        {
+            *slot = carried;
+            return;
+        }
+        if (slot->distance < carried.distance)
+        {
+            RobinSlot evicted = *slot;
+            *slot = carried;
+            carried = evicted;
+        }
+        carried.distance++;
+        index = (index + 1) & mask;
+    }
+}
+
+// The slot holding key, or -1. Stops as soon as the probe is further from
+// home than the slot's own item: an insert would have taken that slot.
+static ptrdiff_t findIndex(RobinCache *cache, uint32_t hash, const char *key, size_t key_len)
+{
+    size_t index = hash & cache->mask;
+    for (uint32_t distance = 1;; distance++)
+    {
+        const RobinSlot *slot = &cache->slots[index];
+        if (slot->distance < distance)
+        {
+            return -1;
+        }
+        if (slotMatches(slot, hash, key, key_len))
+        {
+            return (ptrdiff_t)index;
+        }
+        index = (index + 1) & cache->mask;
+    }
+}
+
+// Backward-shift deletion: every following item that is away from home
+// moves back one slot, until an empty slot or an item already at home
+static void removeAt(RobinCache *cache, size_t index)
+{
+    size_t next = (index + 1) & cache->mask;
+    while (cache->slots[next].distance > 1)
+    {
+        cache->slots[index] = cache->slots[next];
+        cache->slots[index].distance--;
+        index = next;
+        next = (next + 1) & cache->mask;
+    }
+    memset(&cache->slots[index], 0, sizeof(RobinSlot));
+    cache->count--;
+}
+
+// -1 when the new table cannot be allocated; the old one stays
+static int robinGrow(RobinCache *cache)
+{
+    size_t size = (cache->mask + 1) * 2;
+    RobinSlot *slots = calloc(size, sizeof(RobinSlot));
+    if (!slots)
+    {
+        return -1;
+    }
+    for (size_t i = 0; i <= cache->mask; i++)
+    {
+        const RobinSlot *slot = &cache->slots[i];
+        if (slot->distance)
+        {
+            placeFrom(slots, size - 1, slot->hash & (size - 1), 1, slot->hash, slot->item);
+        }
+    }
+    free(cache->slots);
+    cache->slots = slots;
+    cache->mask = size - 1;
+    return 0;
+}
+
+static inline uint32_t robinHash(RobinCache *cache, const char *key, size_t key_len)
+{
+    return (uint32_t)sipHash13(key, key_len, cache->seed);
+}
+
+RobinCache *createRobinCache(void)
+{
+    RobinCache *cache = calloc(1, sizeof(RobinCache));
+    cache->slots = calloc(ROBIN_INITIAL_SLOTS, sizeof(RobinSlot));
+    cache->mask = ROBIN_INITIAL_SLOTS - 1;
+    hashRandomSeed(cache->seed);
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->stats = statsCreate();
+    return cache;
+}
+
+void setRobinCache(RobinCache *cache, const char *key, const char *value, int ttl)
+{
+    size_t key_len = strlen(key), value_len = strlen(value);
+    RobinItem *item = malloc(sizeof(RobinItem) + key_len + value_len + 2);
+    item->expry = time(NULL) + ttl;
+    item->key_len = (uint32_t)key_len;
+    item->value_len = (uint32_t)value_len;
+    memcpy(item->data, key, key_len + 1);
+    memcpy(item->data + key_len + 1, value, value_len + 1);
+    uint32_t hash = robinHash(cache, key, key_len);
+    int64_t new_bytes = itemBytes(item); // item is not ours once the lock drops
+
+    RobinItem *old = NULL;
+    int dropped = 0;
+    // A new key needs room: a grown table, or at ROBIN_MAX_SLOTS a free slot
+    int room = 1;
+    pthread_mutex_lock(&cache->lock);
+    if ((cache->count + 1) * 100 > (cache->mask + 1) * ROBIN_MAX_LOAD_PERCENT)
+    {
+        room = cache->mask + 1 < ROBIN_MAX_SLOTS ? robinGrow(cache) == 0 : cache->count <= cache->mask;
+    }
+    // One walk looks for the key and, failing that, for where it goes
+    size_t index = hash & cache->mask;
+    uint32_t distance = 1;
+    for (;;)
+    {
+        RobinSlot *slot = &cache->slots[index];
+        if (slot->distance < distance && !room)
+        {
+            dropped = 1;
+            break;
+        }
+        if (slot->distance < distance)
+        {
+            placeFrom(cache->slots, cache->mask, index, distance, hash, item);
+            cache->count++;
+            break;
+        }
+        if (slotMatches(slot, hash, key, key_len))
+        {
+            old = slot->item;
+            slot->item = item;
+            break;
+        }
+        distance++;
+        index = (index + 1) & cache->mask;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_SETS, 1);
+    if (dropped)
+    {
+        statsAdd(cache->stats, STAT_DROPPED_SETS, 1);
+        free(item);
+        return;
+    }
+    statsAdd(cache->stats, STAT_ENTRY_BYTES, new_bytes - (old ? itemBytes(old) : 0));
+    statsAdd(cache->stats, STAT_KEY_BYTES, old ? 0 : (int64_t)key_len + 1);
+    statsAdd(cache->stats, STAT_VALUE_BYTES, (int64_t)value_len - (old ? (int64_t)old->value_len : -1));
+    free(old);
+}
+
+// Copies the value like getCacheCopy: full length, or -1 when absent.
+// An expired item is deleted by the get that finds it.
+int getRobinCache(RobinCache *cache, const char *key, char *buf, size_t len)
+{
+    size_t key_len = strlen(key);
+    uint32_t hash = robinHash(cache, key, key_len);
+    RobinItem *expired = NULL;
+    int n = -1;
+    pthread_mutex_lock(&cache->lock);
+    ptrdiff_t index = findIndex(cache, hash, key, key_len);
+    if (index >= 0)
+    {
+        RobinItem *item = cache->slots[index].item;
+        if (time(NULL) >= item->expry)
+        {
+            expired = item;
+            removeAt(cache, (size_t)index);
+        }
+        else
+        {
+            if (len)
+            {
+                size_t copy = item->value_len < len ? item->value_len : len - 1;
+                memcpy(buf, itemValue(item), copy);
+                buf[copy] = '\0';
+            }
+            n = (int)item->value_len;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_GETS, 1);
+    statsAdd(cache->stats, n >= 0 ? STAT_HITS : STAT_MISSES, 1);
+    if (expired)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, 1);
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -itemBytes(expired));
+        statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)expired->key_len - 1);
+        statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)expired->value_len - 1);
+        free(expired);
+    }
+    return n;
+}
+
+void deleteRobinCache(RobinCache *cache, const char *key)
+{
+    size_t key_len = strlen(key);
+    uint32_t hash = robinHash(cache, key, key_len);
+    RobinItem *item = NULL;
+    pthread_mutex_lock(&cache->lock);
+    ptrdiff_t index = findIndex(cache, hash, key, key_len);
+    if (index >= 0)
+    {
+        item = cache->slots[index].item;
+        removeAt(cache, (size_t)index);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    statsAdd(cache->stats, STAT_DELETES, 1);
+    if (item)
+    {
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -itemBytes(item));
+        statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)item->key_len - 1);
+        statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)item->value_len - 1);
+        free(item);
+    }
+}
+
+// No other thread may be using the cache
+void freeRobinCache(RobinCache *cache)
+{
+    for (size_t i = 0; i <= cache->mask; i++)
+    {
+        free(cache->slots[i].item);
+    }
+    free(cache->slots);
+    free(cache->stats);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+// The probe section reports every stored key's distance from home, which
+// is also what a hit on it costs; nothing is sampled
+void getRobinCacheStats(RobinCache *cache, CacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    statsAggregate(cache->stats, stats);
+    TableHealth *h = &stats->health;
+    pthread_mutex_lock(&cache->lock);
+    stats->count = cache->count;
+    stats->table_size = cache->mask + 1;
+    for (size_t i = 0; i <= cache->mask; i++)
+    {
+        uint32_t distance = cache->slots[i].distance;
+        if (distance)
+        {
+            h->samples++;
+            h->length_sum += distance;
+            h->length_max = distance > h->length_max ? distance : h->length_max;
+            h->lengths[probeHistBucket(distance)]++;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    h->ops = h->samples;
+    stats->bucket_bytes = stats->table_size * sizeof(RobinSlot);
+    stats->keyed_hash = 1;
+}
@@ -0,0 +1,57 @@
+#ifndef LAHMACUNROBIN_H
+#define LAHMACUNROBIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacunstats.h"
+
+// Robin Hood open addressing. Slots live in one flat array, each holding
+// the key's hash, its distance from its home slot and a pointer to the
+// item. An insert that meets a slot closer to its home than the new key
+// takes that slot and carries the evicted item on, so probe distances
+// stay short and even. A lookup stops at the first slot whose distance is
+// shorter than its own: the key would have taken that slot. Misses cost
+// about as much as hits instead of a full chain walk.
+//
+// Deletes shift the following run back by one slot rather than leaving
+// tombstones, so the table never needs cleaning. The whole table is
+// guarded by one mutex, like Cache.
+#define ROBIN_INITIAL_SLOTS 4096
+#define ROBIN_MAX_LOAD_PERCENT 90 // grow when count reaches this share of the slots
+
+typedef struct
+{
+    time_t expry;
+    uint32_t key_len;
+    uint32_t value_len;
+    char data[]; // key, NUL, value, NUL
+} RobinItem;
+
+typedef struct
+{
+    uint32_t hash;     // low bits of the key's hash; the home slot is hash & mask
+    uint32_t distance; // probe distance plus one; 0: empty
+    RobinItem *item;
+} RobinSlot;
+
+typedef struct
+{
+    RobinSlot *slots;
+    size_t mask; // slots - 1, at most 2^32 - 1 since the stored hash is 32 bits
+    size_t count;
+    uint64_t seed[2];
+    pthread_mutex_t lock;
+    CacheStatsSlot *stats;
+} RobinCache;
+
+RobinCache *createRobinCache(void);
+void setRobinCache(RobinCache *cache, const char *key, const char *value, int ttl);
+int getRobinCache(RobinCache *cache, const char *key, char *buf, size_t len);
+void deleteRobinCache(RobinCache *cache, const char *key);
+void freeRobinCache(RobinCache *cache);
+void getRobinCacheStats(RobinCache *cache, CacheStats *stats);
+
+#endif
@@ -0,0 +1,142 @@
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "lahmacunshard.h"
+
+static void futexWait(uint32_t *word, uint32_t value)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futexWake(uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static inline void cpuRelax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+void shardQueueInit(ShardQueue *queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+    queue->sleeping = 0;
+}
+
+static void queueLink(ShardQueue *queue, ShardRequest *request)
+{
+    request->next = NULL;
+    ShardRequest *prev = __atomic_exchange_n(&queue->head, request, __ATOMIC_ACQ_REL);
+    // seq_cst so a consumer going to sleep cannot miss it (see shardNext)
+    __atomic_store_n(&prev->next, request, __ATOMIC_SEQ_CST);
+}
+
+void shardPush(ShardQueue *queue, ShardRequest *request)
+{
+    queueLink(queue, request);
+    if (__atomic_exchange_n(&queue->sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+        futexWake(&queue->sleeping);
+    }
+}
+
+// NULL when empty, or while a producer is between its two steps
+static ShardRequest *queuePop(ShardQueue *queue)
+{
+    ShardRequest *tail = queue->tail;
+    ShardRequest *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &queue->stub)
+    {
+        if (!next)
+        {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    // tail is the last request: put the stub behind it so it can be handed out
+    queueLink(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+// Consumer side: the next request, sleeping while there is none
+ShardRequest *shardNext(ShardQueue *queue)
+{
+    for (int spins = 0;; spins++)
+    {
+        ShardRequest *request = queuePop(queue);
+        if (request)
+        {
+            return request;
+        }
+        if (spins < SHARD_SPINS)
+        {
+            cpuRelax();
+            continue;
+        }
+        __atomic_store_n(&queue->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (queue->tail == &queue->stub && !__atomic_load_n(&queue->stub.next, __ATOMIC_SEQ_CST))
+        {
+            futexWait(&queue->sleeping, 1);
+        }
+        __atomic_store_n(&queue->sleeping, 0, __ATOMIC_RELAXED);
+        spins = 0;
+    }
+}
+
+// The request may be gone as soon as done is set; waking its address
+// afterwards is harmless
+void shardComplete(ShardRequest *request)
+{
+    if (__atomic_exchange_n(&request->done, 1, __ATOMIC_ACQ_REL) == 2)
+    {
+        futexWake(&request->done);
+    }
+}
+
+void shardWait(ShardRequest *request)
+{
+    for (int spins = 0; spins < SHARD_SPINS; spins++)
+    {
+        if (__atomic_load_n(&request->done, __ATOMIC_ACQUIRE) == 1)
+        {
+            return;
+        }
+        cpuRelax();
+    }
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&request->done, &expected, 2, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        expected = 2;
+    }
+    while (expected != 1)
+    {
+        futexWait(&request->done, 2);
+        expected = __atomic_load_n(&request->done, __ATOMIC_ACQUIRE);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef LAHMACUNSHARD_H
+#define LAHMACUNSHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lahmacunstats.h"
+
+// Delegation: each shard's table is owned by one worker thread and clients
+// hand it operations through an intrusive lock-free MPSC queue (Vyukov).
+// A request lives on the client's stack and doubles as its completion
+// slot. Both sides spin briefly before sleeping on a futex, so an idle
+// worker costs nothing and a busy one never makes a system call.
+#define SHARD_SPINS 256
+
+typedef enum
+{
+    SHARD_GET,
+    SHARD_COPY, // get, copying the value into buf while the worker owns it
+    SHARD_SET,
+    SHARD_DELETE,
+    SHARD_RESEED,
+    SHARD_STATS,  // data: CacheStats to add the table's shape to
+    SHARD_MEMORY, // data: CacheMemory to add the table's allocations to
+    SHARD_STOP
+} ShardOp;
+
+typedef struct ShardRequest
+{
+    struct ShardRequest *next;
+    uint32_t done; // 0 pending, 1 done, 2 client asleep
+    ShardOp op;
+    const char *key;
+    void *data; // entry: in for set, out for delete; out for get, the value
+    int64_t expired;
+    char *buf; // SHARD_COPY
+    size_t len; // SHARD_COPY: in the size of buf, out the value length
+} ShardRequest;
+
+typedef struct
+{
+    ShardRequest *head __attribute__((aligned(CACHE_LINE_SIZE))); // producers swap themselves in here
+    ShardRequest *tail __attribute__((aligned(CACHE_LINE_SIZE))); // consumer only
+    ShardRequest stub;
+    uint32_t sleeping __attribute__((aligned(CACHE_LINE_SIZE)));
+} ShardQueue;
+
+void shardQueueInit(ShardQueue *queue);
+void shardPush(ShardQueue *queue, ShardRequest *request);
+ShardRequest *shardNext(ShardQueue *queue);
+void shardComplete(ShardRequest *request);
+void shardWait(ShardRequest *request);
+
+#endif
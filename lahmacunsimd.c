@@ -0,0 +1,139 @@
+#include "lahmacunsimd.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+static uint32_t djb2(const char *key, size_t len)
+{
+    unsigned int hash = 5381;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = ((hash << 5) + hash) + key[i];
+    }
+    return hash;
+}
+
+#ifdef SIMD_X86
+
+// 16 <= len: 16 byte steps, the last one ending exactly at len. The
+// differences are or-ed together and tested once, keys being mostly equal
+// by the time their hashes and lengths matched.
+__attribute__((target("sse2"))) static int equalSse2(const char *a, const char *b, size_t len)
+{
+    __m128i diff = _mm_setzero_si128();
+    for (size_t i = 0; i + 16 < len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        diff = _mm_or_si128(diff, _mm_xor_si128(x, y));
+    }
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + len - 16));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + len - 16));
+    diff = _mm_or_si128(diff, _mm_xor_si128(x, y));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xffff;
+}
+
+// 32 < len <= 64: the first and the last 32 bytes
+__attribute__((target("avx2"))) static int equalAvx2(const char *a, const char *b, size_t len)
+{
+    __m256i head = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)a), _mm256_loadu_si256((const __m256i *)b));
+    __m256i tail = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(a + len - 32)),
+                                    _mm256_loadu_si256((const __m256i *)(b + len - 32)));
+    __m256i diff = _mm256_or_si256(head, tail);
+    return _mm256_testz_si256(diff, diff);
+}
+
+// 8 bytes per crc32 step. The last partial word is loaded so that it ends
+// at len and shifted down past the bytes already hashed; keys shorter than
+// a word are gathered with overlapping loads. Either way there is no byte
+// loop and no read past len. Zero-padded tails and overlapping gathers
+// make keys of different lengths feed the same words ("a" and "aaa"), so
+// len is hashed in last.
+__attribute__((target("sse4.2"))) static uint32_t crc32cHw(const char *key, size_t len)
+{
+    uint64_t crc = 0xffffffffu;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, key + i, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+    size_t rest = len - i;
+    if (rest && len >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, key + len - 8, 8);
+        crc = _mm_crc32_u64(crc, word >> (8 * (8 - rest)));
+    }
+    else if (rest >= 4)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, key, 4);
+        memcpy(&hi, key + len - 4, 4);
+        crc = _mm_crc32_u64(crc, lo | (uint64_t)hi << 32);
+    }
+    else if (rest)
+    {
+        uint32_t word = (uint8_t)key[0] | (uint32_t)(uint8_t)key[len / 2] << 8 | (uint32_t)(uint8_t)key[len - 1] << 16;
+        crc = _mm_crc32_u64(crc, word);
+    }
+    crc = _mm_crc32_u32((uint32_t)crc, (uint32_t)len);
+    return ~(uint32_t)crc;
+}
+
+// Past 64 bytes libc's memcmp, itself dispatched to AVX2 or wider, with
+// unrolled loads, beat a plain loop of these kernels in lahmacun-bench
+int keyEqualWide(const char *a, const char *b, size_t len)
+{
+    if (len > 64)
+    {
+        return memcmp(a, b, len) == 0;
+    }
+    if (len > 32 && __builtin_cpu_supports("avx2"))
+    {
+        return equalAvx2(a, b, len);
+    }
+    return equalSse2(a, b, len);
+}
+
+uint32_t keyCrc32c(const char *key, size_t len)
+{
+    return __builtin_cpu_supports("sse4.2") ? crc32cHw(key, len) : djb2(key, len);
+}
+
+int simdCrcActive(void)
+{
+    return __builtin_cpu_supports("sse4.2") != 0;
+}
+
+const char *simdEqualKernel(void)
+{
+    return __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+}
+
+#else
+
+int keyEqualWide(const char *a, const char *b, size_t len)
+{
+    return memcmp(a, b, len) == 0;
+}
+
+uint32_t keyCrc32c(const char *key, size_t len)
+{
+    return djb2(key, len);
+}
+
+int simdCrcActive(void)
+{
+    return 0;
+}
+
+const char *simdEqualKernel(void)
+{
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef LAHMACUNSIMD_H
+#define LAHMACUNSIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Key equality and hashing for keys whose length is already known. Keys
+// up to 64 bytes are compared with two overlapping loads and no loop: two
+// words below 16 bytes, two SSE2 vectors up to 32, two AVX2 vectors up to
+// 64, so nothing past len is read. Longer keys go to memcmp. keyCrc32c
+// hashes 8 bytes per instruction with SSE4.2's crc32 and falls back to
+// djb2 on CPUs (or builds) without it. Kernels are picked from cpuid, the
+// same way for every call in a process, so every table sees one hash.
+
+int keyEqualWide(const char *a, const char *b, size_t len);
+uint32_t keyCrc32c(const char *key, size_t len);
+
+// 1 when keyCrc32c runs on the crc32 instruction, 0 when it is djb2
+int simdCrcActive(void);
+// "avx2", "sse2" or "scalar": the widest equality kernel in use
+const char *simdEqualKernel(void);
+
+static inline int keyEqual(const char *a, const char *b, size_t len)
+{
+    if (len >= 16)
+    {
+        return keyEqualWide(a, b, len);
+    }
+    if (len >= 8)
+    {
+        uint64_t a0, a1, b0, b1;
+        memcpy(&a0, a, 8);
+        memcpy(&b0, b, 8);
+        memcpy(&a1, a + len - 8, 8);
+        memcpy(&b1, b + len - 8, 8);
+        return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+    }
+    if (len >= 4)
+    {
+        uint32_t a0, a1, b0, b1;
+        memcpy(&a0, a, 4);
+        memcpy(&b0, b, 4);
+        memcpy(&a1, a + len - 4, 4);
+        memcpy(&b1, b + len - 4, 4);
+        return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (a[i] != b[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lahmacunhash.h"
+#include "lahmacunsplit.h"
+
+#define SPLIT_MAX_BUCKETS (1ull << 40)
+
+static _Thread_local unsigned int split_writes;
+
+static inline uint64_t reverseBits(uint64_t x)
+{
+    x = __builtin_bswap64(x);
+    x = (x & 0x0f0f0f0f0f0f0f0full) << 4 | (x >> 4 & 0x0f0f0f0f0f0f0f0full);
+    x = (x & 0x3333333333333333ull) << 2 | (x >> 2 & 0x3333333333333333ull);
+    return (x & 0x5555555555555555ull) << 1 | (x >> 1 & 0x5555555555555555ull);
+}
+
+// The top bit set before reversing makes key orders odd, so a bucket's
+// dummy sorts before every key that hashes to it
+static inline uint64_t keyOrder(uint64_t hash)
+{
+    return reverseBits(hash | 1ull << 63);
+}
+
+static inline uint64_t dummyOrder(size_t bucket)
+{
+    return reverseBits(bucket);
+}
+
+static inline SplitNode *nodeOf(uintptr_t link)
+{
+    return (SplitNode *)(link & ~(uintptr_t)1);
+}
+
+static SplitNode *newNode(const char *key, uint64_t order)
+{
+    size_t len = strlen(key);
+    SplitNode *node = malloc(sizeof(SplitNode) + len + 1);
+    memcpy(node->key, key, len + 1);
+    node->order = order;
+    node->value = NULL;
+    node->next = 0;
+    return node;
+}
+
+static inline int64_t nodeBytes(const SplitNode *node)
+{
+    return (int64_t)(sizeof(SplitNode) + strlen(node->key) + 1);
+}
+
+static inline int64_t valueBytes(const SplitValue *value)
+{
+    return (int64_t)(sizeof(SplitValue) + value->len + 1);
+}
+
+static inline void splitReclaim(SplitCache *cache)
+{
+    if (++split_writes % SPLIT_RECLAIM_INTERVAL == 0)
+    {
+        epochTryReclaim(cache->epoch);
+    }
+}
+
+static SplitNode **bucketSlot(SplitCache *cache, size_t bucket)
+{
+    unsigned int seg = 0;
+    size_t offset = bucket, size = SPLIT_INITIAL_BUCKETS;
+    if (bucket >= SPLIT_INITIAL_BUCKETS)
+    {
+        unsigned int high = 63 - (unsigned int)__builtin_clzll(bucket);
+        seg = high - (unsigned int)__builtin_ctzll(SPLIT_INITIAL_BUCKETS) + 1;
+        size = (size_t)1 << high;
+        offset = bucket - size;
+    }
+    SplitNode **segment = __atomic_load_n(&cache->segments[seg], __ATOMIC_ACQUIRE);
+    if (!segment)
+    {
+        SplitNode **fresh = calloc(size, sizeof(SplitNode *));
+        if (__atomic_compare_exchange_n(&cache->segments[seg], &segment, fresh, 0, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE))
+        {
+            segment = fresh;
+        }
+        else
+        {
+            free(fresh);
+        }
+    }
+    return &segment[offset];
+}
+
+static inline int nodeCompare(const SplitNode *node, uint64_t order, const char *key)
+{
+    if (node->order != order)
+    {
+        return node->order < order ? -1 : 1;
+    }
+    return (order & 1) ? strcmp(node->key, key) : 0;
+}
+
+// Harris-Michael search from head: *prev is the link that points, or
+// would point, at the first node not before (order, key), and *cur that
+// node. Marked nodes passed on the way are unlinked and retired. 1 when
+// *cur is the node for the key.
+static int listFind(SplitCache *cache, SplitNode *head, uint64_t order, const char *key, uintptr_t **prev,
+                    SplitNode **cur)
+{
+    for (;;)
+    {
+        uintptr_t *link = &head->next;
+        SplitNode *node = nodeOf(__atomic_load_n(link, __ATOMIC_ACQUIRE));
+        int restart = 0;
+        while (node && !restart)
+        {
+            uintptr_t next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+            if (__atomic_load_n(link, __ATOMIC_ACQUIRE) != (uintptr_t)node)
+            {
+                restart = 1;
+            }
+            else if (!(next & 1))
+            {
+                int cmp = nodeCompare(node, order, key);
+                if (cmp >= 0)
+                {
+                    *prev = link;
+                    *cur = node;
+                    return cmp == 0;
+                }
+                link = &node->next;
+                node = nodeOf(next);
+            }
+            else
+            {
+                uintptr_t expected = (uintptr_t)node;
+                if (__atomic_compare_exchange_n(link, &expected, next & ~(uintptr_t)1, 0, __ATOMIC_ACQ_REL,
+                                                __ATOMIC_RELAXED))
+                {
+                    epochRetire(cache->epoch, node);
+                    node = nodeOf(next);
+                }
+                else
+                {
+                    restart = 1;
+                }
+            }
+        }
+        if (!restart)
+        {
+            *prev = link;
+            *cur = NULL;
+            return 0;
+        }
+    }
+}
+
+// Links node in after head's position; the node already there for the
+// same (order, key) if there is one, else NULL
+static SplitNode *listInsert(SplitCache *cache, SplitNode *head, SplitNode *node)
+{
+    for (;;)
+    {
+        uintptr_t *prev;
+        SplitNode *cur;
+        if (listFind(cache, head, node->order, node->key, &prev, &cur))
+        {
+            return cur;
+        }
+        node->next = (uintptr_t)cur;
+        uintptr_t expected = (uintptr_t)cur;
+        if (__atomic_compare_exchange_n(prev, &expected, (uintptr_t)node, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+            return NULL;
+        }
+    }
+}
+
+// Logical delete; the next listFind over it unlinks it
+static void markNode(SplitNode *node)
+{
+    uintptr_t next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+    while (!(next & 1) &&
+           !__atomic_compare_exchange_n(&node->next, &next, next | 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+    }
+}
+
+// A bucket's dummy, created on first use by splitting its parent bucket
+// (the bucket index without its top bit)
+static SplitNode *bucketHead(SplitCache *cache, size_t bucket)
+{
+    SplitNode **slot = bucketSlot(cache, bucket);
+    SplitNode *head = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (head)
+    {
+        return head;
+    }
+    size_t parent = bucket & ~((size_t)1 << (63 - __builtin_clzll(bucket)));
+    SplitNode *dummy = newNode("", dummyOrder(bucket));
+    SplitNode *existing = listInsert(cache, bucketHead(cache, parent), dummy);
+    if (existing)
+    {
+        free(dummy);
+        dummy = existing;
+    }
+    __atomic_compare_exchange_n(slot, &head, dummy, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    return dummy;
+}
+
+static inline SplitNode *keyHead(SplitCache *cache, uint64_t hash)
+{
+    size_t size = __atomic_load_n(&cache->split_size, __ATOMIC_ACQUIRE);
+    return bucketHead(cache, hash & (size - 1));
+}
+
+// Takes a live node's value for NULL, then marks and unlinks the node.
+// The value, or NULL when another thread got there first.
+static SplitValue *removeNode(SplitCache *cache, SplitNode *head, SplitNode *node, SplitValue *value)
+{
+    if (!__atomic_compare_exchange_n(&node->value, &value, NULL, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+    markNode(node);
+    uintptr_t *prev;
+    SplitNode *cur;
+    listFind(cache, head, node->order, node->key, &prev, &cur);
+    __atomic_fetch_sub(&cache->count, 1, __ATOMIC_RELAXED);
+    epochRetire(cache->epoch, value);
+    return value;
+}
+
+SplitCache *createSplitCache(void)
+{
+    SplitCache *cache;
+    if (posix_memalign((void **)&cache, CACHE_LINE_SIZE, sizeof(SplitCache)) != 0)
+    {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(SplitCache));
+    hashRandomSeed(cache->seed);
+    cache->split_size = SPLIT_INITIAL_BUCKETS;
+    cache->epoch = epochCreate();
+    cache->stats = statsCreate();
+    *bucketSlot(cache, 0) = newNode("", dummyOrder(0));
+    return cache;
+}
+
+void setSplitCache(SplitCache *cache, const char *key, const char *value, int ttl)
+{
+    size_t len = strlen(value);
+    SplitValue *fresh = malloc(sizeof(SplitValue) + len + 1);
+    memcpy(fresh->data, value, len + 1);
+    fresh->len = len;
+    fresh->expry = time(NULL) + ttl;
+
+    uint64_t hash = sipHash13(key, strlen(key), cache->seed);
+    uint64_t order = keyOrder(hash);
+    SplitNode *node = NULL;
+    int64_t node_bytes = 0, old_bytes = 0, old_len = -1;
+    unsigned int slot = epochEnterSlot(cache->epoch);
+    SplitNode *head = keyHead(cache, hash);
+    for (;;)
+    {
+        uintptr_t *prev;
+        SplitNode *cur;
+        if (listFind(cache, head, order, key, &prev, &cur))
+        {
+            SplitValue *old = __atomic_load_n(&cur->value, __ATOMIC_ACQUIRE);
+            while (old && !__atomic_compare_exchange_n(&cur->value, &old, fresh, 0, __ATOMIC_ACQ_REL,
+                                                       __ATOMIC_ACQUIRE))
+            {
+            }
+            if (old)
+            {
+                old_bytes = valueBytes(old);
+                old_len = (int64_t)old->len;
+                epochRetire(cache->epoch, old);
+                break;
+            }
+            // Being deleted: help it out of the list and insert anew
+            markNode(cur);
+            continue;
+        }
+        if (!node)
+        {
+            node = newNode(key, order);
+            node->value = fresh;
+        }
+        node->next = (uintptr_t)cur;
+        uintptr_t expected = (uintptr_t)cur;
+        if (__atomic_compare_exchange_n(prev, &expected, (uintptr_t)node, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        {
+            node_bytes = nodeBytes(node);
+            node = NULL;
+            break;
+        }
+    }
+    epochExit(cache->epoch, slot);
+    free(node);
+
+    if (node_bytes)
+    {
+        // Lock-free growth: more buckets only means finer dummies from now on
+        size_t count = __atomic_add_fetch(&cache->count, 1, __ATOMIC_RELAXED);
+        size_t size = __atomic_load_n(&cache->split_size, __ATOMIC_RELAXED);
+        if (count > size * SPLIT_LOAD_FACTOR && size < SPLIT_MAX_BUCKETS)
+        {
+            __atomic_compare_exchange_n(&cache->split_size, &size, size * 2, 0, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED);
+        }
+        statsAdd(cache->stats, STAT_KEY_BYTES, (int64_t)strlen(key) + 1);
+    }
+    statsAdd(cache->stats, STAT_SETS, 1);
+    statsAdd(cache->stats, STAT_ENTRY_BYTES, node_bytes + valueBytes(fresh) - old_bytes);
+    statsAdd(cache->stats, STAT_VALUE_BYTES, (int64_t)len - old_len);
+    splitReclaim(cache);
+}
+
+// Copies the value like getCacheCopy: full length, or -1 when absent. An
+// expired value is deleted on the way, unless a set replaced it first.
+int getSplitCache(SplitCache *cache, const char *key, char *buf, size_t len)
+{
+    uint64_t hash = sipHash13(key, strlen(key), cache->seed);
+    int n = -1;
+    int64_t expired_bytes = 0;
+    unsigned int slot = epochEnterSlot(cache->epoch);
+    SplitNode *head = keyHead(cache, hash);
+    uintptr_t *prev;
+    SplitNode *node;
+    if (listFind(cache, head, keyOrder(hash), key, &prev, &node))
+    {
+        SplitValue *value = __atomic_load_n(&node->value, __ATOMIC_ACQUIRE);
+        if (value && time(NULL) < value->expry)
+        {
+            n = (int)value->len;
+            if (len)
+            {
+                size_t copy = value->len < len ? value->len : len - 1;
+                memcpy(buf, value->data, copy);
+                buf[copy] = '\0';
+            }
+        }
+        else if (value && removeNode(cache, head, node, value))
+        {
+            expired_bytes = nodeBytes(node) + valueBytes(value);
+            statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)strlen(node->key) - 1);
+            statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)value->len - 1);
+        }
+    }
+    epochExit(cache->epoch, slot);
+
+    statsAdd(cache->stats, STAT_GETS, 1);
+    statsAdd(cache->stats, n >= 0 ? STAT_HITS : STAT_MISSES, 1);
+    if (expired_bytes)
+    {
+        statsAdd(cache->stats, STAT_EXPIRATIONS, 1);
+        statsAdd(cache->stats, STAT_ENTRY_BYTES, -expired_bytes);
+        splitReclaim(cache);
+    }
+    return n;
+}
+
+void deleteSplitCache(SplitCache *cache, const char *key)
+{
+    uint64_t hash = sipHash13(key, strlen(key), cache->seed);
+    int64_t removed_bytes = 0;
+    unsigned int slot = epochEnterSlot(cache->epoch);
+    SplitNode *head = keyHead(cache, hash);
+    uintptr_t *prev;
+    SplitNode *node;
+    if (listFind(cache, head, keyOrder(hash), key, &prev, &node))
+    {
+        SplitValue *value = __atomic_load_n(&node->value, __ATOMIC_ACQUIRE);
+        while (value && !removeNode(cache, head, node, value))
+        {
+            value = __atomic_load_n(&node->value, __ATOMIC_ACQUIRE);
+        }
+        if (value)
+        {
+            removed_bytes = nodeBytes(node) + valueBytes(value);
+            statsAdd(cache->stats, STAT_KEY_BYTES, -(int64_t)strlen(node->key) - 1);
+            statsAdd(cache->stats, STAT_VALUE_BYTES, -(int64_t)value->len - 1);
+        }
+    }
+    epochExit(cache->epoch, slot);
+
+    statsAdd(cache->stats, STAT_DELETES, 1);
+    statsAdd(cache->stats, STAT_ENTRY_BYTES, -removed_bytes);
+    splitReclaim(cache);
+}
+
+// No other thread may be using the cache
+void freeSplitCache(SplitCache *cache)
+{
+    SplitNode *node = *bucketSlot(cache, 0);
+    while (node)
+    {
+        SplitNode *next = nodeOf(node->next);
+        free(node->value);
+        free(node);
+        node = next;
+    }
+    for (int seg = 0; seg < SPLIT_SEGMENTS; seg++)
+    {
+        free(cache->segments[seg]);
+    }
+    epochFree(cache->epoch);
+    free(cache->stats);
+    free(cache);
+}
+
+// Counters plus the list shape; bucket_bytes are the segment arrays and
+// the dummies in use. Never blocks writers.
+void getSplitCacheStats(SplitCache *cache, CacheStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    statsAggregate(cache->stats, stats);
+    stats->count = __atomic_load_n(&cache->count, __ATOMIC_RELAXED);
+    stats->table_size = __atomic_load_n(&cache->split_size, __ATOMIC_RELAXED);
+    stats->keyed_hash = 1;
+    size_t size = SPLIT_INITIAL_BUCKETS;
+    for (int seg = 0; seg < SPLIT_SEGMENTS; seg++)
+    {
+        if (__atomic_load_n(&cache->segments[seg], __ATOMIC_RELAXED))
+        {
+            stats->bucket_bytes += size * sizeof(SplitNode *);
+        }
+        size = seg ? size * 2 : size;
+    }
+    stats->bucket_bytes += stats->table_size * (sizeof(SplitNode) + 1);
+}
@@ -0,0 +1,61 @@
+#ifndef LAHMACUNSPLIT_H
+#define LAHMACUNSPLIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "lahmacunepoch.h"
+#include "lahmacunstats.h"
+
+// Lock-free alternative to Cache: Shalev and Shavit's split-ordered list.
+// Every key lives in one Harris-Michael sorted list, ordered by its
+// bit-reversed hash; a bucket is a shortcut into the list through a dummy
+// node. Doubling the bucket count only changes split_size: new buckets
+// are initialised lazily by splitting their parent, so nothing is ever
+// rehashed or moved and there is no global pause.
+//
+// A key's value hangs off its node and is swapped with one CAS, so sets
+// of a stored key never touch the list. Deleting first swaps the value
+// for NULL and only then marks the node; a node is unlinked only once it
+// is marked, so a set that sees NULL helps unlink and inserts anew.
+// Readers and writers run inside an epoch section (lahmacunepoch.h) and
+// unlinked nodes and replaced values are freed through it.
+#define SPLIT_INITIAL_BUCKETS 1024
+#define SPLIT_LOAD_FACTOR 2
+#define SPLIT_SEGMENTS 48 // segment 0 holds SPLIT_INITIAL_BUCKETS, segment s after it 2^(s-1) times as many
+#define SPLIT_RECLAIM_INTERVAL 64 // writes per thread between reclaim attempts
+
+typedef struct
+{
+    time_t expry;
+    size_t len; // terminator excluded
+    char data[];
+} SplitValue;
+
+typedef struct SplitNode
+{
+    uintptr_t next; // low bit: this node is deleted
+    uint64_t order; // bit-reversed hash; odd for keys, even for bucket dummies
+    SplitValue *value; // NULL once deleted; always NULL for dummies
+    char key[];
+} SplitNode;
+
+typedef struct
+{
+    SplitNode **segments[SPLIT_SEGMENTS];
+    uint64_t seed[2];
+    size_t split_size __attribute__((aligned(CACHE_LINE_SIZE))); // buckets in use, a power of two
+    size_t count __attribute__((aligned(CACHE_LINE_SIZE)));
+    EpochDomain *epoch;
+    CacheStatsSlot *stats;
+} SplitCache;
+
+SplitCache *createSplitCache(void);
+void setSplitCache(SplitCache *cache, const char *key, const char *value, int ttl);
+int getSplitCache(SplitCache *cache, const char *key, char *buf, size_t len);
+void deleteSplitCache(SplitCache *cache, const char *key);
+void freeSplitCache(SplitCache *cache);
+void getSplitCacheStats(SplitCache *cache, CacheStats *stats);
+
+#endif
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lahmacunstats.h"
+
+_Thread_local int stats_thread_slot = -1;
+
+static unsigned int next_slot;
+
+int statsAssignSlot(void)
+{
+    stats_thread_slot = (int)(__atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % STATS_SLOTS);
+    return stats_thread_slot;
+}
+
+CacheStatsSlot *statsCreate(void)
+{
+    void *slots;
+    if (posix_memalign(&slots, CACHE_LINE_SIZE, STATS_SLOTS * sizeof(CacheStatsSlot)) != 0)
+    {
+        return NULL;
+    }
+    memset(slots, 0, STATS_SLOTS * sizeof(CacheStatsSlot));
+    return slots;
+}
+
+void statsAggregate(const CacheStatsSlot *slots, CacheStats *stats)
+{
+    int64_t sum[STAT_COUNT] = {0};
+    for (int s = 0; s < STATS_SLOTS; s++)
+    {
+        for (int i = 0; i < STAT_COUNT; i++)
+        {
+            sum[i] += __atomic_load_n(&slots[s].counters[i], __ATOMIC_RELAXED);
+        }
+    }
+    stats->gets = (uint64_t)sum[STAT_GETS];
+    stats->hits = (uint64_t)sum[STAT_HITS];
+    stats->near_hits = (uint64_t)sum[STAT_NEAR_HITS];
+    stats->replica_hits = (uint64_t)sum[STAT_REPLICA_HITS];
+    stats->misses = (uint64_t)sum[STAT_MISSES];
+    stats->sets = (uint64_t)sum[STAT_SETS];
+    stats->deletes = (uint64_t)sum[STAT_DELETES];
+    stats->combine_batches = (uint64_t)sum[STAT_COMBINE_BATCHES];
+    stats->combined_writes = (uint64_t)sum[STAT_COMBINED_WRITES];
+    stats->optimistic_retries = (uint64_t)sum[STAT_OPTIMISTIC_RETRIES];
+    stats->optimistic_fallbacks = (uint64_t)sum[STAT_OPTIMISTIC_FALLBACKS];
+    stats->dropped_sets = (uint64_t)sum[STAT_DROPPED_SETS];
+    stats->expirations = (uint64_t)sum[STAT_EXPIRATIONS];
+    stats->evictions = (uint64_t)sum[STAT_EVICTIONS];
+    stats->entry_bytes = (uint64_t)sum[STAT_ENTRY_BYTES];
+    stats->key_bytes = (uint64_t)sum[STAT_KEY_BYTES];
+    stats->value_bytes = (uint64_t)sum[STAT_VALUE_BYTES];
+}
+
+const char *const memory_class_names[MEMORY_CLASS_COUNT] = {"entry", "buckets", "old_buckets"};
+const char *const latency_op_names[LAT_COUNT] = {"get", "set", "delete", "lock_wait"};
+const char *const lock_site_names[LOCK_SITE_COUNT] = {"set", "get", "delete", "combine", "resize", "other"};
+
+LatencyRecorder *latencyCreate(void)
+{
+    histTicksPerNs();
+    return calloc(1, sizeof(LatencyRecorder));
+}
+
+void latencyFree(LatencyRecorder *recorder)
+{
+    for (int s = 0; s < STATS_SLOTS; s++)
+    {
+        free(recorder->slots[s]);
+    }
+    free(recorder);
+}
+
+// Threads sharing a slot may race here; the loser frees its copy
+LatencySlot *latencySlotCreate(LatencyRecorder *recorder, unsigned int slot)
+{
+    LatencySlot *fresh = calloc(1, sizeof(LatencySlot));
+    LatencySlot *expected = NULL;
+    if (!__atomic_compare_exchange_n(&recorder->slots[slot], &expected, fresh, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        free(fresh);
+        return expected;
+    }
+    return fresh;
+}
+
+void latencyMerge(const LatencyRecorder *recorder, LatencyOp op, Histogram *merged)
+{
+    memset(merged, 0, sizeof(*merged));
+    for (int s = 0; s < STATS_SLOTS; s++)
+    {
+        const LatencySlot *latency = __atomic_load_n(&recorder->slots[s], __ATOMIC_ACQUIRE);
+        if (latency)
+        {
+            histMerge(merged, &latency->ops[op]);
+        }
+    }
+}
+
+void latencySummarize(const LatencyRecorder *recorder, LatencySummary *summary)
+{
+    double ticks_per_ns = histTicksPerNs();
+    Histogram *merged = malloc(sizeof(Histogram));
+    for (int op = 0; op < LAT_COUNT; op++)
+    {
+        latencyMerge(recorder, (LatencyOp)op, merged);
+        summary[op].count = histTotal(merged);
+        summary[op].mean_ns = histMean(merged) / ticks_per_ns;
+        summary[op].p50_ns = (double)histPercentile(merged, 50) / ticks_per_ns;
+        summary[op].p99_ns = (double)histPercentile(merged, 99) / ticks_per_ns;
+        summary[op].p999_ns = (double)histPercentile(merged, 99.9) / ticks_per_ns;
+        summary[op].max_ns = (double)histMax(merged) / ticks_per_ns;
+    }
+    free(merged);
+}
+
+void lockProfileSummarize(const LockProfile *profile, LockSiteSummary *summary)
+{
+    double ticks_per_ns = histTicksPerNs();
+    for (int site = 0; site < LOCK_SITE_COUNT; site++)
+    {
+        const LockSiteProfile *p = &profile->sites[site];
+        summary[site].acquisitions = p->acquisitions;
+        summary[site].contended = p->contended;
+        summary[site].wait_ns = (double)p->wait_ticks / ticks_per_ns;
+        summary[site].hold_ns = (double)p->hold_ticks / ticks_per_ns;
+        summary[site].max_hold_ns = (double)p->max_hold_ticks / ticks_per_ns;
+    }
+}
+
+// Lock section: totals, then one line per call site ordered by hold time
+static int formatLockProfile(const CacheStats *stats, char *buf, size_t len)
+{
+    const LockSiteSummary *sites = stats->lock_sites;
+    int order[LOCK_SITE_COUNT];
+    uint64_t acquisitions = 0, contended = 0;
+    double wait_ns = 0, hold_ns = 0;
+    for (int site = 0; site < LOCK_SITE_COUNT; site++)
+    {
+        order[site] = site;
+        // resize runs inside a set's acquisition, it is not one of its own
+        if (site != LOCK_SITE_RESIZE)
+        {
+            acquisitions += sites[site].acquisitions;
+            contended += sites[site].contended;
+        }
+        wait_ns += sites[site].wait_ns;
+        hold_ns += sites[site].hold_ns;
+    }
+    for (int i = 1; i < LOCK_SITE_COUNT; i++)
+    {
+        for (int j = i; j > 0 && sites[order[j]].hold_ns > sites[order[j - 1]].hold_ns; j--)
+        {
+            int tmp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+
+    int n = snprintf(buf, len,
+                     "# Lock\r\n"
+                     "lock_acquisitions:%llu\r\n"
+                     "lock_contended:%llu\r\n"
+                     "lock_contention_ratio:%.4f\r\n"
+                     "lock_wait_us:%.1f\r\n"
+                     "lock_hold_us:%.1f\r\n",
+                     (unsigned long long)acquisitions, (unsigned long long)contended,
+                     acquisitions ? (double)contended / (double)acquisitions : 0.0,
+                     wait_ns / 1000.0, hold_ns / 1000.0);
+    for (int i = 0; i < LOCK_SITE_COUNT; i++)
+    {
+        const LockSiteSummary *l = &sites[order[i]];
+        n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0,
+                      "lock_holder_%s:holds=%llu,contended=%llu,wait_us=%.1f,hold_us=%.1f,max_hold_us=%.1f\r\n",
+                      lock_site_names[order[i]], (unsigned long long)l->acquisitions,
+                      (unsigned long long)l->contended, l->wait_ns / 1000.0, l->hold_ns / 1000.0,
+                      l->max_hold_ns / 1000.0);
+    }
+    return n;
+}
+
+// Table section: hash in use, reseeds and the sampled probe lengths
+static int formatTableHealth(const CacheStats *stats, char *buf, size_t len)
+{
+    const TableHealth *h = &stats->health;
+    const char *hash_function = stats->keyed_hash ? "siphash13" : "djb2";
+    if (stats->hash_function)
+    {
+        hash_function = stats->hash_function;
+    }
+    int n = snprintf(buf, len,
+                     "# Table\r\n"
+                     "hash_function:%s\r\n"
+                     "rehashing:%d\r\n"
+                     "reseeds:%llu\r\n"
+                     "probe_samples:%llu\r\n"
+                     "probe_length_avg:%.2f\r\n"
+                     "probe_length_max:%llu\r\n"
+                     "probe_length_hist:",
+                     hash_function, stats->rehashing,
+                     (unsigned long long)h->reseeds, (unsigned long long)h->samples,
+                     h->samples ? (double)h->length_sum / (double)h->samples : 0.0,
+                     (unsigned long long)h->length_max);
+    const char *sep = "";
+    for (unsigned int b = 0; b < PROBE_HIST_BUCKETS; b++)
+    {
+        if (!h->lengths[b])
+        {
+            continue;
+        }
+        uint64_t low = b ? 1ull << (b - 1) : 0;
+        uint64_t high = (1ull << b) - 1;
+        char range[48];
+        if (b == PROBE_HIST_BUCKETS - 1)
+        {
+            snprintf(range, sizeof(range), "%llu+", (unsigned long long)low);
+        }
+        else if (low == high)
+        {
+            snprintf(range, sizeof(range), "%llu", (unsigned long long)low);
+        }
+        else
+        {
+            snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)low, (unsigned long long)high);
+        }
+        n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0, "%s%s=%llu", sep, range,
+                      (unsigned long long)h->lengths[b]);
+        sep = ",";
+    }
+    n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0, "\r\n");
+    return n;
+}
+
+// Redis INFO style "field:value" lines, ready to be sent as a stats reply
+int formatCacheStats(const CacheStats *stats, char *buf, size_t len)
+{
+    double hit_ratio = stats->gets ? (double)stats->hits / (double)stats->gets : 0.0;
+    int n = snprintf(buf, len,
+                     "# Stats\r\n"
+                     "get_commands:%llu\r\n"
+                     "get_hits:%llu\r\n"
+                     "get_misses:%llu\r\n"
+                     "near_cache_hits:%llu\r\n"
+                     "hot_replica_hits:%llu\r\n"
+                     "hit_ratio:%.4f\r\n"
+                     "set_commands:%llu\r\n"
+                     "delete_commands:%llu\r\n"
+                     "combine_batches:%llu\r\n"
+                     "combined_writes:%llu\r\n"
+                     "optimistic_retries:%llu\r\n"
+                     "optimistic_fallbacks:%llu\r\n"
+                     "dropped_sets:%llu\r\n"
+                     "expired_keys:%llu\r\n"
+                     "evicted_keys:%llu\r\n"
+                     "# Memory\r\n"
+                     "used_memory:%llu\r\n"
+                     "entry_bytes:%llu\r\n"
+                     "bucket_bytes:%llu\r\n"
+                     "# Keyspace\r\n"
+                     "keys:%zu\r\n"
+                     "table_size:%zu\r\n"
+                     "load_factor:%.4f\r\n",
+                     (unsigned long long)stats->gets, (unsigned long long)stats->hits,
+                     (unsigned long long)stats->misses, (unsigned long long)stats->near_hits,
+                     (unsigned long long)stats->replica_hits, hit_ratio,
+                     (unsigned long long)stats->sets, (unsigned long long)stats->deletes,
+                     (unsigned long long)stats->combine_batches, (unsigned long long)stats->combined_writes,
+                     (unsigned long long)stats->optimistic_retries, (unsigned long long)stats->optimistic_fallbacks,
+                     (unsigned long long)stats->dropped_sets,
+                     (unsigned long long)stats->expirations, (unsigned long long)stats->evictions,
+                     (unsigned long long)(stats->entry_bytes + stats->bucket_bytes),
+                     (unsigned long long)stats->entry_bytes, (unsigned long long)stats->bucket_bytes,
+                     stats->count, stats->table_size,
+                     stats->table_size ? (double)stats->count / (double)stats->table_size : 0.0);
+    n += formatTableHealth(stats, buf + n, (size_t)n < len ? len - (size_t)n : 0);
+    if (stats->has_hot_keys)
+    {
+        n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0,
+                      "# Hot keys\r\n"
+                      "hot_key_samples:%llu\r\n"
+                      "hot_key_promotions:%llu\r\n"
+                      "hot_keys:%u\r\n",
+                      (unsigned long long)stats->hot_samples, (unsigned long long)stats->hot_promotions,
+                      stats->hot_key_count);
+        for (unsigned int i = 0; i < stats->hot_key_count; i++)
+        {
+            n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0, "hot_key_%u:key=%s,count=%llu\r\n", i,
+                          stats->hot_keys[i], (unsigned long long)stats->hot_counts[i]);
+        }
+    }
+    if (stats->has_latency)
+    {
+        n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0, "# Latency\r\n");
+        for (int op = 0; op < LAT_COUNT; op++)
+        {
+            const LatencySummary *l = &stats->latency[op];
+            n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0,
+                          "%s_latency:count=%llu,mean_ns=%.0f,p50_ns=%.0f,p99_ns=%.0f,p999_ns=%.0f,max_ns=%.0f\r\n",
+                          latency_op_names[op], (unsigned long long)l->count, l->mean_ns, l->p50_ns,
+                          l->p99_ns, l->p999_ns, l->max_ns);
+        }
+    }
+    if (stats->has_lock_profile)
+    {
+        n += formatLockProfile(stats, buf + n, (size_t)n < len ? len - (size_t)n : 0);
+    }
+    return n;
+}
+
+// Memory breakdown in the same field:value format, one line per size class
+int formatCacheMemory(const CacheMemory *memory, char *buf, size_t len)
+{
+    int n = snprintf(buf, len,
+                     "# Memory detail\r\n"
+                     "bucket_bytes:%llu\r\n"
+                     "entry_header_bytes:%llu\r\n"
+                     "key_bytes:%llu\r\n"
+                     "key_reserved_bytes:%llu\r\n"
+                     "value_bytes:%llu\r\n"
+                     "value_reserved_bytes:%llu\r\n"
+                     "allocator_overhead_bytes:%llu\r\n"
+                     "allocator_free_bytes:%llu\r\n"
+                     "rss_bytes:%llu\r\n"
+                     "arena_bytes:%llu\r\n"
+                     "huge_page_bytes:%llu\r\n"
+                     "anon_huge_bytes:%llu\r\n"
+                     "fragmentation_ratio:%.2f\r\n",
+                     (unsigned long long)memory->bucket_bytes, (unsigned long long)memory->entry_header_bytes,
+                     (unsigned long long)memory->key_bytes, (unsigned long long)memory->key_reserved_bytes,
+                     (unsigned long long)memory->value_bytes, (unsigned long long)memory->value_reserved_bytes,
+                     (unsigned long long)memory->allocator_overhead_bytes,
+                     (unsigned long long)memory->allocator_free_bytes, (unsigned long long)memory->rss_bytes,
+                     (unsigned long long)memory->arena_bytes, (unsigned long long)memory->huge_page_bytes,
+                     (unsigned long long)memory->anon_huge_bytes, memory->fragmentation_ratio);
+    for (int c = 0; c < MEMORY_CLASS_COUNT; c++)
+    {
+        const MemorySizeClass *sc = &memory->classes[c];
+        if (!sc->count)
+        {
+            continue;
+        }
+        n += snprintf(buf + n, (size_t)n < len ? len - (size_t)n : 0,
+                      "size_class_%s:size=%zu,chunk=%zu,count=%llu,overhead_bytes=%llu\r\n",
+                      memory_class_names[c], sc->size, sc->chunk, (unsigned long long)sc->count,
+                      (unsigned long long)((sc->chunk - sc->size) * sc->count));
+    }
+    return n;
+}
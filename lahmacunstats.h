@@ -0,0 +1,293 @@
+#ifndef LAHMACUNSTATS_H
+#define LAHMACUNSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lahmacunhist.h"
+#include "lahmacunhot.h"
+
+#define CACHE_LINE_SIZE 64
+#define STATS_SLOTS 64
+
+typedef enum
+{
+    STAT_GETS,
+    STAT_HITS,
+    STAT_MISSES,
+    STAT_SETS,
+    STAT_DELETES,
+    STAT_EXPIRATIONS,
+    STAT_EVICTIONS,
+    STAT_ENTRY_BYTES,
+    STAT_KEY_BYTES,   // key field bytes in use, terminator included
+    STAT_VALUE_BYTES, // value field bytes in use, terminator included
+    STAT_NEAR_HITS,   // gets answered by the thread's near cache, also counted in STAT_HITS
+    STAT_REPLICA_HITS, // gets answered by a per-CPU hot key copy, also counted in STAT_HITS
+    STAT_COMBINE_BATCHES, // lock acquisitions that ran published writes
+    STAT_COMBINED_WRITES, // writes run by a combiner, the combiner's own included
+    STAT_OPTIMISTIC_RETRIES, // lock-free copy-out reads that raced a writer and retried
+    STAT_OPTIMISTIC_FALLBACKS, // copy-out reads that gave up and took the lock
+    STAT_DROPPED_SETS, // sets of new keys dropped because the table could not grow
+    STAT_COUNT
+} CacheStat;
+
+// Counters of one thread slot, cache-line aligned and padded to whole
+// lines. A thread only ever writes its own slot, so the hot path never
+// shares a written line with other threads; readers sum every slot on
+// demand.
+typedef struct
+{
+    int64_t counters[STAT_COUNT];
+} __attribute__((aligned(CACHE_LINE_SIZE))) CacheStatsSlot;
+
+typedef enum
+{
+    LAT_GET,
+    LAT_SET,
+    LAT_DELETE,
+    LAT_LOCK_WAIT,
+    LAT_COUNT
+} LatencyOp;
+
+// Per-thread-slot histograms of operation latency in ticks (histTicks),
+// allocated the first time a slot records anything
+typedef struct
+{
+    Histogram ops[LAT_COUNT];
+} LatencySlot;
+
+typedef struct
+{
+    LatencySlot *slots[STATS_SLOTS];
+} LatencyRecorder;
+
+typedef enum
+{
+    LOCK_SITE_SET,
+    LOCK_SITE_GET,
+    LOCK_SITE_DELETE,
+    LOCK_SITE_COMBINE, // running a batch of published writes
+    LOCK_SITE_RESIZE, // nested inside a set's hold, and not counted in it
+    LOCK_SITE_OTHER,  // stats snapshots, tracing control
+    LOCK_SITE_COUNT
+} LockSite;
+
+typedef struct
+{
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_ticks;
+    uint64_t hold_ticks;
+    uint64_t max_hold_ticks;
+} LockSiteProfile;
+
+// Cache.lock contention profile. Only ever written by the lock holder, so
+// plain fields are enough; readers snapshot it under the lock.
+typedef struct
+{
+    LockSiteProfile sites[LOCK_SITE_COUNT];
+    LockSite holder;
+    uint64_t acquired_at;
+    uint64_t nested_ticks;
+} LockProfile;
+
+#define PROBE_HIST_BUCKETS 16
+
+// Sampled chain walk lengths of lookups and deletes. Written under
+// Cache.lock like LockProfile; window_* feed the flood detector.
+typedef struct
+{
+    uint64_t ops;
+    uint64_t samples;
+    uint64_t length_sum;
+    uint64_t length_max;
+    uint64_t lengths[PROBE_HIST_BUCKETS]; // 0, 1, 2-3, 4-7, ... (last is open ended)
+    uint64_t window_sum;
+    unsigned int window_samples;
+    uint64_t reseeds;
+    uint64_t reseed_after_ops; // backoff: no reseed before ops reaches this
+} TableHealth;
+
+// Power-of-two bucket of a probe length
+static inline unsigned int probeHistBucket(uint64_t length)
+{
+    unsigned int bucket = length ? 64 - (unsigned int)__builtin_clzll(length) : 0;
+    return bucket < PROBE_HIST_BUCKETS ? bucket : PROBE_HIST_BUCKETS - 1;
+}
+
+typedef struct
+{
+    uint64_t acquisitions;
+    uint64_t contended;
+    double wait_ns;
+    double hold_ns;
+    double max_hold_ns;
+} LockSiteSummary;
+
+typedef struct
+{
+    uint64_t count;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+} LatencySummary;
+
+typedef struct
+{
+    uint64_t gets;
+    uint64_t hits;
+    uint64_t near_hits;
+    uint64_t replica_hits;
+    uint64_t misses;
+    uint64_t sets;
+    uint64_t deletes;
+    uint64_t combine_batches;
+    uint64_t combined_writes;
+    uint64_t optimistic_retries;
+    uint64_t optimistic_fallbacks;
+    uint64_t dropped_sets;
+    uint64_t expirations;
+    uint64_t evictions; // no eviction policy exists yet, always 0
+    uint64_t entry_bytes;
+    uint64_t key_bytes;
+    uint64_t value_bytes;
+    uint64_t bucket_bytes;
+    size_t count;
+    size_t table_size;
+    int keyed_hash;
+    const char *hash_function; // reported instead of siphash13/djb2 when set
+    int rehashing;
+    TableHealth health;
+    int has_hot_keys;
+    uint64_t hot_samples;
+    uint64_t hot_promotions;
+    unsigned int hot_key_count;
+    char hot_keys[HOT_KEYS][HOT_KEY_PREFIX];
+    uint64_t hot_counts[HOT_KEYS];
+    int has_latency;
+    LatencySummary latency[LAT_COUNT];
+    int has_lock_profile;
+    LockSiteSummary lock_sites[LOCK_SITE_COUNT];
+} CacheStats;
+
+typedef enum
+{
+    MEMORY_CLASS_ENTRY,
+    MEMORY_CLASS_BUCKETS,
+    MEMORY_CLASS_OLD_BUCKETS, // only while a reseed is draining the old table
+    MEMORY_CLASS_COUNT
+} MemoryClass;
+
+// One allocation size the cache makes, and what the allocator turns it
+// into (chunk: usable size plus its size header, an estimate outside glibc)
+typedef struct
+{
+    size_t size;
+    size_t chunk;
+    uint64_t count;
+} MemorySizeClass;
+
+// Where the cache's bytes go. Reserved bytes are the entries' inline
+// areas plus spilled key/value buffers; used bytes are what the stored
+// strings occupy in them.
+typedef struct
+{
+    uint64_t bucket_bytes;
+    uint64_t entry_header_bytes; // chain pointer, expiry, seq, hash, lengths and flags
+    uint64_t key_bytes;
+    uint64_t key_reserved_bytes;
+    uint64_t value_bytes;
+    uint64_t value_reserved_bytes;
+    uint64_t allocator_overhead_bytes;
+    uint64_t allocator_free_bytes; // malloc free lists, whole process (glibc only)
+    uint64_t rss_bytes;
+    uint64_t arena_bytes;     // entry slab chunks mapped, free slots included (CacheOptions.huge_pages)
+    uint64_t huge_page_bytes; // bucket arrays and slab chunks mapped from hugetlbfs or advised for THP
+    uint64_t anon_huge_bytes; // AnonHugePages: what the kernel actually backs with THP, whole process
+    MemorySizeClass classes[MEMORY_CLASS_COUNT];
+    double fragmentation_ratio; // allocated chunks / bytes actually needed
+} CacheMemory;
+
+extern const char *const memory_class_names[MEMORY_CLASS_COUNT];
+extern const char *const latency_op_names[LAT_COUNT];
+extern const char *const lock_site_names[LOCK_SITE_COUNT];
+extern _Thread_local int stats_thread_slot;
+
+int statsAssignSlot(void);
+
+// Slot of the calling thread, assigned round robin on first use
+static inline unsigned int statsThreadSlot(void)
+{
+    int slot = stats_thread_slot;
+    return (unsigned int)(slot >= 0 ? slot : statsAssignSlot());
+}
+
+// Relaxed add to the caller's own line: uncontended unless more than
+// STATS_SLOTS threads are running at once
+static inline void statsAdd(CacheStatsSlot *slots, CacheStat stat, int64_t n)
+{
+    __atomic_fetch_add(&slots[statsThreadSlot()].counters[stat], n, __ATOMIC_RELAXED);
+}
+
+LatencySlot *latencySlotCreate(LatencyRecorder *recorder, unsigned int slot);
+
+static inline void latencyRecord(LatencyRecorder *recorder, LatencyOp op, uint64_t ticks)
+{
+    unsigned int slot = statsThreadSlot();
+    LatencySlot *latency = __atomic_load_n(&recorder->slots[slot], __ATOMIC_ACQUIRE);
+    if (!latency)
+    {
+        latency = latencySlotCreate(recorder, slot);
+    }
+    histRecord(&latency->ops[op], ticks);
+}
+
+static inline void lockProfileAcquired(LockProfile *profile, LockSite site, int contended, uint64_t wait_ticks)
+{
+    LockSiteProfile *p = &profile->sites[site];
+    p->acquisitions++;
+    p->contended += (uint64_t)contended;
+    p->wait_ticks += wait_ticks;
+    profile->holder = site;
+    profile->nested_ticks = 0;
+    profile->acquired_at = histTicks();
+}
+
+static inline void lockProfileReleased(LockProfile *profile)
+{
+    uint64_t hold = histTicks() - profile->acquired_at - profile->nested_ticks;
+    LockSiteProfile *p = &profile->sites[profile->holder];
+    p->hold_ticks += hold;
+    if (hold > p->max_hold_ticks)
+    {
+        p->max_hold_ticks = hold;
+    }
+}
+
+// Time spent in a nested site (resize) is charged to it, not to the holder
+static inline void lockProfileNested(LockProfile *profile, LockSite site, uint64_t ticks)
+{
+    LockSiteProfile *p = &profile->sites[site];
+    p->acquisitions++;
+    p->hold_ticks += ticks;
+    if (ticks > p->max_hold_ticks)
+    {
+        p->max_hold_ticks = ticks;
+    }
+    profile->nested_ticks += ticks;
+}
+
+CacheStatsSlot *statsCreate(void);
+void statsAggregate(const CacheStatsSlot *slots, CacheStats *stats);
+LatencyRecorder *latencyCreate(void);
+void latencyFree(LatencyRecorder *recorder);
+void latencyMerge(const LatencyRecorder *recorder, LatencyOp op, Histogram *merged);
+void latencySummarize(const LatencyRecorder *recorder, LatencySummary *summary);
+void lockProfileSummarize(const LockProfile *profile, LockSiteSummary *summary);
+int formatCacheStats(const CacheStats *stats, char *buf, size_t len);
+int formatCacheMemory(const CacheMemory *memory, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lahmacuntrace.h"
+
+#define TRACE_BUFFER_SIZE (1 << 20)
+#define TRACE_HEADER_SIZE 24
+
+static uint64_t monotonicNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static size_t putVarint(unsigned char *buf, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    return n;
+}
+
+static int getVarint(FILE *file, uint64_t *v)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(file);
+        if (c == EOF)
+        {
+            return -1;
+        }
+        result |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+        {
+            *v = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void putLE(unsigned char *buf, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buf[i] = (unsigned char)(v >> (i * 8));
+    }
+}
+
+static uint64_t getLE(const unsigned char *buf, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+    {
+        v |= (uint64_t)buf[i] << (i * 8);
+    }
+    return v;
+}
+
+// FNV-1a; also returns the key length so callers walk the key once
+uint64_t traceKeyHash(const char *key, size_t *key_len)
+{
+    uint64_t h = 14695981039346656037ull;
+    const char *p = key;
+    while (*p)
+    {
+        h ^= (unsigned char)*p++;
+        h *= 1099511628211ull;
+    }
+    *key_len = (size_t)(p - key);
+    return h;
+}
+
+int traceOpen(CacheTracer *tracer, const char *path, unsigned int sample_rate)
+{
+    sample_rate = sample_rate ? sample_rate : 1;
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        return -1;
+    }
+    tracer->buffer = malloc(TRACE_BUFFER_SIZE);
+    setvbuf(file, tracer->buffer, _IOFBF, TRACE_BUFFER_SIZE);
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    unsigned char header[TRACE_HEADER_SIZE];
+    memcpy(header, TRACE_MAGIC, 8);
+    putLE(header + 8, TRACE_VERSION, 4);
+    putLE(header + 12, sample_rate, 4);
+    putLE(header + 16, (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec, 8);
+    fwrite(header, 1, sizeof(header), file);
+
+    tracer->file = file;
+    tracer->sample_rate = sample_rate;
+    tracer->start_ns = monotonicNanos();
+    tracer->last_ns = 0;
+    tracer->records = 0;
+    __atomic_store_n(&tracer->active, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void traceRecord(CacheTracer *tracer, uint8_t op, uint64_t key_hash, size_t key_len, size_t value_size, int ttl)
+{
+    unsigned char buf[48];
+    pthread_mutex_lock(&tracer->lock);
+    if (!tracer->active)
+    {
+        pthread_mutex_unlock(&tracer->lock);
+        return;
+    }
+    // Timestamps are taken under the lock so deltas are never negative
+    uint64_t ts = monotonicNanos() - tracer->start_ns;
+    uint64_t zigzag_ttl = ((uint64_t)(int64_t)ttl << 1) ^ (uint64_t)((int64_t)ttl >> 63);
+    size_t n = 0;
+    buf[n++] = op;
+    n += putVarint(buf + n, ts - tracer->last_ns);
+    putLE(buf + n, key_hash, 8);
+    n += 8;
+    n += putVarint(buf + n, key_len);
+    n += putVarint(buf + n, value_size);
+    n += putVarint(buf + n, zigzag_ttl);
+    fwrite(buf, 1, n, tracer->file);
+    tracer->last_ns = ts;
+    tracer->records++;
+    pthread_mutex_unlock(&tracer->lock);
+}
+
+void traceClose(CacheTracer *tracer)
+{
+    pthread_mutex_lock(&tracer->lock);
+    if (tracer->active)
+    {
+        __atomic_store_n(&tracer->active, 0, __ATOMIC_RELEASE);
+        fclose(tracer->file);
+        free(tracer->buffer);
+        tracer->file = NULL;
+        tracer->buffer = NULL;
+    }
+    pthread_mutex_unlock(&tracer->lock);
+}
+
+int traceReaderOpen(TraceReader *reader, const char *path)
+{
+    unsigned char header[TRACE_HEADER_SIZE];
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+    {
+        return -1;
+    }
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+        memcmp(header, TRACE_MAGIC, 8) != 0 || getLE(header + 8, 4) != TRACE_VERSION)
+    {
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    reader->sample_rate = (unsigned int)getLE(header + 12, 4);
+    reader->start_unix_ns = getLE(header + 16, 8);
+    reader->last_ns = 0;
+    return 0;
+}
+
+// Returns 1 for a record, 0 at end of file and -1 for a truncated record
+int traceReadNext(TraceReader *reader, TraceRecord *record)
+{
+    unsigned char hash[8];
+    uint64_t delta, key_len, value_size, zigzag_ttl;
+    int op = fgetc(reader->file);
+    if (op == EOF)
+    {
+        return 0;
+    }
+    if (getVarint(reader->file, &delta) ||
+        fread(hash, 1, sizeof(hash), reader->file) != sizeof(hash) ||
+        getVarint(reader->file, &key_len) ||
+        getVarint(reader->file, &value_size) ||
+        getVarint(reader->file, &zigzag_ttl))
+    {
+        return -1;
+    }
+    reader->last_ns += delta;
+    record->timestamp_ns = reader->last_ns;
+    record->key_hash = getLE(hash, 8);
+    record->key_len = (uint32_t)key_len;
+    record->value_size = (uint32_t)value_size;
+    record->ttl = (int32_t)((zigzag_ttl >> 1) ^ (~(zigzag_ttl & 1) + 1));
+    record->op = (uint8_t)op;
+    return 1;
+}
+
+void traceReaderClose(TraceReader *reader)
+{
+    if (reader->file)
+    {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef LAHMACUNTRACE_H
+#define LAHMACUNTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// Trace file: a 24 byte header (magic, version, sample rate, start time in
+// unix ns) followed by variable length records. Each record is the op byte,
+// the timestamp delta from the previous record as a varint, the 64-bit key
+// hash, then key length, value size and zigzag TTL as varints.
+#define TRACE_MAGIC "LHTRACE1"
+#define TRACE_VERSION 1
+#define TRACE_HIT 0x80
+
+typedef enum
+{
+    TRACE_GET = 1,
+    TRACE_SET = 2,
+    TRACE_DELETE = 3
+} TraceOp;
+
+typedef struct
+{
+    uint64_t timestamp_ns; // since the start of the trace
+    uint64_t key_hash;
+    uint32_t key_len;
+    uint32_t value_size;
+    int32_t ttl;
+    uint8_t op; // TraceOp, or'ed with TRACE_HIT for get hits
+} TraceRecord;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    FILE *file;
+    char *buffer;
+    int active;
+    unsigned int sample_rate;
+    uint64_t start_ns;
+    uint64_t last_ns;
+    uint64_t records;
+} CacheTracer;
+
+typedef struct
+{
+    FILE *file;
+    unsigned int sample_rate;
+    uint64_t start_unix_ns;
+    uint64_t last_ns;
+} TraceReader;
+
+uint64_t traceKeyHash(const char *key, size_t *key_len);
+int traceOpen(CacheTracer *tracer, const char *path, unsigned int sample_rate);
+void traceRecord(CacheTracer *tracer, uint8_t op, uint64_t key_hash, size_t key_len, size_t value_size, int ttl);
+void traceClose(CacheTracer *tracer);
+
+int traceReaderOpen(TraceReader *reader, const char *path);
+int traceReadNext(TraceReader *reader, TraceRecord *record);
+void traceReaderClose(TraceReader *reader);
+
+#endif